@@ -0,0 +1,309 @@
+// This file is part of yt-media-storage, a tool for encoding media.
+// Copyright (C) Brandon Li <https://brandonli.me/>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Wirehair encode/decode micro-benchmark. Sweeps block count N, symbol size, repair ratio
+// and loss pattern, and prints one JSON document to stdout (progress goes to stderr).
+//
+//   bench_fec [--n 64,1024,...] [--symbol-size 256,...] [--repair 0.1,...]
+//             [--loss random,burst,source-only] [--iterations 3] [--quick]
+
+#include "wirehair/wirehair.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    enum class LossPattern {
+        Random,
+        Burst,
+        SourceOnly,
+    };
+
+    const char *loss_pattern_name(const LossPattern pattern) {
+        switch (pattern) {
+            case LossPattern::Random: return "random";
+            case LossPattern::Burst: return "burst";
+            case LossPattern::SourceOnly: return "source-only";
+        }
+        return "unknown";
+    }
+
+    struct BenchConfig {
+        std::vector<uint32_t> block_counts{64, 256, 1024, 4096, 16384, 64000};
+        std::vector<uint32_t> symbol_sizes{256, 1024, 4096};
+        std::vector<double> repair_ratios{0.1, 0.5, 1.0};
+        std::vector<LossPattern> losses{LossPattern::Random, LossPattern::Burst, LossPattern::SourceOnly};
+        int iterations = 3;
+    };
+
+    struct Sample {
+        double create_ns = 0;
+        double encode_ns = 0;
+        double decode_ns = 0;
+        double recover_ns = 0;
+        uint32_t symbols_fed = 0;
+        bool ok = true;
+    };
+
+    double elapsed_ns(const Clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    // Ids of the symbols that survive the channel, in transmission order (sources then repairs).
+    std::vector<uint32_t> surviving_ids(const uint32_t n, const uint32_t repair, const LossPattern pattern,
+                                        std::mt19937 &rng) {
+        std::vector<uint32_t> ids;
+        ids.reserve(n + repair);
+        switch (pattern) {
+            case LossPattern::SourceOnly:
+                for (uint32_t id = 0; id < n; ++id) ids.push_back(id);
+                break;
+            case LossPattern::Random: {
+                // Drop half of what the repair budget could cover, spread uniformly.
+                const double p = 0.5 * repair / static_cast<double>(n + repair);
+                std::bernoulli_distribution drop(p);
+                for (uint32_t id = 0; id < n + repair; ++id) {
+                    if (!drop(rng)) ids.push_back(id);
+                }
+                break;
+            }
+            case LossPattern::Burst: {
+                // One contiguous run of lost source symbols, half the repair budget long.
+                const uint32_t burst = std::min(n, repair / 2);
+                const uint32_t start = std::uniform_int_distribution<uint32_t>(0, n - burst)(rng);
+                for (uint32_t id = 0; id < n + repair; ++id) {
+                    if (id < start || id >= start + burst) ids.push_back(id);
+                }
+                break;
+            }
+        }
+        return ids;
+    }
+
+    Sample run_once(const std::vector<uint8_t> &message, const uint32_t n, const uint32_t symbol_size,
+                    const uint32_t repair, const LossPattern pattern, std::mt19937 &rng) {
+        Sample sample;
+        const auto message_bytes = static_cast<uint64_t>(message.size());
+
+        auto start = Clock::now();
+        const WirehairCodec encoder = wirehair_encoder_create(nullptr, message.data(), message_bytes, symbol_size);
+        sample.create_ns = elapsed_ns(start);
+        if (!encoder) {
+            sample.ok = false;
+            return sample;
+        }
+
+        std::vector<uint8_t> blocks(static_cast<std::size_t>(n + repair) * symbol_size);
+        std::vector<uint32_t> lengths(n + repair);
+        start = Clock::now();
+        for (uint32_t id = 0; id < n + repair; ++id) {
+            if (wirehair_encode(encoder, id, blocks.data() + static_cast<std::size_t>(id) * symbol_size,
+                                symbol_size, &lengths[id]) != Wirehair_Success) {
+                sample.ok = false;
+            }
+        }
+        sample.encode_ns = elapsed_ns(start);
+        wirehair_free(encoder);
+
+        const auto ids = surviving_ids(n, repair, pattern, rng);
+        const WirehairCodec decoder = wirehair_decoder_create(nullptr, message_bytes, symbol_size);
+        if (!decoder) {
+            sample.ok = false;
+            return sample;
+        }
+
+        WirehairResult result = Wirehair_NeedMore;
+        start = Clock::now();
+        for (const uint32_t id: ids) {
+            ++sample.symbols_fed;
+            result = wirehair_decode(decoder, id, blocks.data() + static_cast<std::size_t>(id) * symbol_size,
+                                     lengths[id]);
+            if (result != Wirehair_NeedMore) {
+                break;
+            }
+        }
+        sample.decode_ns = elapsed_ns(start);
+
+        if (result == Wirehair_Success) {
+            std::vector<uint8_t> recovered(message.size());
+            start = Clock::now();
+            result = wirehair_recover(decoder, recovered.data(), message_bytes);
+            sample.recover_ns = elapsed_ns(start);
+            sample.ok = result == Wirehair_Success && recovered == message;
+        } else {
+            sample.ok = false;
+        }
+        wirehair_free(decoder);
+        return sample;
+    }
+
+    double median(std::vector<double> values) {
+        std::ranges::sort(values);
+        return values[values.size() / 2];
+    }
+
+    double mb_per_s(const std::size_t bytes, const double ns) {
+        return ns > 0 ? static_cast<double>(bytes) / ns * 1e3 : 0.0;
+    }
+
+    template<typename T>
+    std::vector<T> parse_list(const std::string &text) {
+        std::vector<T> values;
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            if constexpr (std::is_floating_point_v<T>) {
+                values.push_back(static_cast<T>(std::stod(item)));
+            } else {
+                values.push_back(static_cast<T>(std::stoul(item)));
+            }
+        }
+        return values;
+    }
+
+    std::vector<LossPattern> parse_losses(const std::string &text) {
+        std::vector<LossPattern> values;
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            if (item == "random") values.push_back(LossPattern::Random);
+            else if (item == "burst") values.push_back(LossPattern::Burst);
+            else if (item == "source-only") values.push_back(LossPattern::SourceOnly);
+            else throw std::invalid_argument("unknown loss pattern '" + item + "'");
+        }
+        return values;
+    }
+
+    void print_usage(const char *program) {
+        std::cerr << "Usage: " << program
+                << " [--n <list>] [--symbol-size <list>] [--repair <list>]"
+                << " [--loss random,burst,source-only] [--iterations <count>] [--quick]\n";
+    }
+}
+
+int main(const int argc, char *argv[]) {
+    BenchConfig config;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            if (const std::string arg = argv[i]; arg == "--n" && i + 1 < argc) {
+                config.block_counts = parse_list<uint32_t>(argv[++i]);
+            } else if (arg == "--symbol-size" && i + 1 < argc) {
+                config.symbol_sizes = parse_list<uint32_t>(argv[++i]);
+            } else if (arg == "--repair" && i + 1 < argc) {
+                config.repair_ratios = parse_list<double>(argv[++i]);
+            } else if (arg == "--loss" && i + 1 < argc) {
+                config.losses = parse_losses(argv[++i]);
+            } else if (arg == "--iterations" && i + 1 < argc) {
+                config.iterations = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--quick") {
+                config.block_counts = {64, 1024, 4096};
+                config.symbol_sizes = {256};
+                config.repair_ratios = {1.0};
+                config.iterations = 1;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (wirehair_init() != Wirehair_Success) {
+        std::cerr << "Error: wirehair_init failed\n";
+        return 1;
+    }
+
+    std::mt19937 rng(0x59544653);
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "{\n  \"benchmark\": \"bench_fec\",\n  \"codec\": \"wirehair\",\n  \"results\": [";
+
+    bool first = true;
+    bool all_ok = true;
+    for (const uint32_t n: config.block_counts) {
+        for (const uint32_t symbol_size: config.symbol_sizes) {
+            std::vector<uint8_t> message(static_cast<std::size_t>(n) * symbol_size);
+            for (auto &byte: message) byte = static_cast<uint8_t>(rng());
+
+            for (const double ratio: config.repair_ratios) {
+                const auto repair = std::max<uint32_t>(1, static_cast<uint32_t>(std::ceil(n * ratio)));
+                for (const LossPattern pattern: config.losses) {
+                    std::cerr << "N=" << n << " T=" << symbol_size << " repair=" << ratio
+                            << " loss=" << loss_pattern_name(pattern) << "\n";
+
+                    std::vector<double> create, encode, decode, recover;
+                    uint32_t symbols_fed = 0;
+                    bool ok = true;
+                    for (int it = 0; it < config.iterations; ++it) {
+                        const Sample s = run_once(message, n, symbol_size, repair, pattern, rng);
+                        create.push_back(s.create_ns);
+                        encode.push_back(s.encode_ns);
+                        decode.push_back(s.decode_ns);
+                        recover.push_back(s.recover_ns);
+                        symbols_fed = s.symbols_fed;
+                        ok = ok && s.ok;
+                    }
+                    all_ok = all_ok && ok;
+
+                    const double create_ns = median(create);
+                    const double encode_ns = median(encode);
+                    const double decode_ns = median(decode);
+                    const double recover_ns = median(recover);
+                    const std::size_t bytes = message.size();
+
+                    std::cout << (first ? "\n" : ",\n") << "    {"
+                            << "\"n\": " << n
+                            << ", \"symbol_size\": " << symbol_size
+                            << ", \"repair_ratio\": " << ratio
+                            << ", \"repair_symbols\": " << repair
+                            << ", \"loss\": \"" << loss_pattern_name(pattern) << "\""
+                            << ", \"iterations\": " << config.iterations
+                            << ", \"ok\": " << (ok ? "true" : "false")
+                            << ", \"symbols_fed\": " << symbols_fed
+                            << ", \"encoder_create_ns\": " << create_ns
+                            << ", \"encoder_create_mb_s\": " << mb_per_s(bytes, create_ns)
+                            << ", \"encode_ns_per_symbol\": " << encode_ns / (n + repair)
+                            << ", \"encode_mb_s\": " << mb_per_s(bytes + static_cast<std::size_t>(repair) * symbol_size, encode_ns)
+                            << ", \"decode_ns_per_symbol\": " << decode_ns / std::max<uint32_t>(1, symbols_fed)
+                            << ", \"decode_mb_s\": " << mb_per_s(bytes, decode_ns)
+                            << ", \"recover_ns\": " << recover_ns
+                            << ", \"decode_recover_mb_s\": " << mb_per_s(bytes, decode_ns + recover_ns)
+                            << "}";
+                    first = false;
+                }
+            }
+        }
+    }
+
+    std::cout << "\n  ]\n}\n";
+    return all_ok ? 0 : 1;
+}
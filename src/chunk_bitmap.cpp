@@ -0,0 +1,63 @@
+// This file is part of yt-media-storage, a tool for encoding media.
+// Copyright (C) Brandon Li <https://brandonli.me/>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "chunk_bitmap.h"
+
+ChunkBitmap::ChunkBitmap()
+    : pages_(std::make_unique<std::atomic<Word *>[]>(PAGE_COUNT)) {
+}
+
+ChunkBitmap::~ChunkBitmap() {
+    for (std::size_t i = 0; i < PAGE_COUNT; ++i) {
+        delete[] pages_[i].load(std::memory_order_relaxed);
+    }
+}
+
+bool ChunkBitmap::test(const uint32_t index) const noexcept {
+    const Word *page = pages_[index >> PAGE_BITS_LOG2].load(std::memory_order_acquire);
+    if (!page) {
+        return false;
+    }
+    const uint32_t bit = index & ((1u << PAGE_BITS_LOG2) - 1);
+    return (page[bit / 64].load(std::memory_order_acquire) >> (bit % 64)) & 1;
+}
+
+bool ChunkBitmap::set(const uint32_t index) {
+    Word *page = page_for(index);
+    const uint32_t bit = index & ((1u << PAGE_BITS_LOG2) - 1);
+    const uint64_t mask = uint64_t{1} << (bit % 64);
+    if (page[bit / 64].fetch_or(mask, std::memory_order_acq_rel) & mask) {
+        return false;
+    }
+    count_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+ChunkBitmap::Word *ChunkBitmap::page_for(const uint32_t index) {
+    auto &slot = pages_[index >> PAGE_BITS_LOG2];
+    Word *page = slot.load(std::memory_order_acquire);
+    if (page) {
+        return page;
+    }
+
+    // Racing installers each build a zeroed page; the loser frees its copy.
+    auto *fresh = new Word[WORDS_PER_PAGE]();
+    if (slot.compare_exchange_strong(page, fresh, std::memory_order_acq_rel, std::memory_order_acquire)) {
+        return fresh;
+    }
+    delete[] fresh;
+    return page;
+}
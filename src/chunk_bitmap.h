@@ -0,0 +1,57 @@
+/*
+ * This file is part of yt-media-storage, a tool for encoding media.
+ * Copyright (C) Brandon Li <https://brandonli.me/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// One bit per chunk index, safe to test and set from any thread. Bits live in pages that
+// are installed on first use and never moved, so lookups never take a lock and the
+// table costs nothing for index ranges a file does not use.
+class ChunkBitmap {
+public:
+    ChunkBitmap();
+
+    ~ChunkBitmap();
+
+    ChunkBitmap(const ChunkBitmap &) = delete;
+
+    ChunkBitmap &operator=(const ChunkBitmap &) = delete;
+
+    [[nodiscard]] bool test(uint32_t index) const noexcept;
+
+    // Returns true if the bit was newly set by this call.
+    bool set(uint32_t index);
+
+    [[nodiscard]] std::size_t count() const noexcept { return count_.load(std::memory_order_relaxed); }
+
+private:
+    using Word = std::atomic<uint64_t>;
+
+    static constexpr unsigned PAGE_BITS_LOG2 = 18;
+    static constexpr std::size_t WORDS_PER_PAGE = (std::size_t{1} << PAGE_BITS_LOG2) / 64;
+    static constexpr std::size_t PAGE_COUNT = std::size_t{1} << (32 - PAGE_BITS_LOG2);
+
+    std::unique_ptr<std::atomic<Word *>[]> pages_;
+    std::atomic<std::size_t> count_{0};
+
+    [[nodiscard]] Word *page_for(uint32_t index);
+};
@@ -0,0 +1,79 @@
+// This file is part of yt-media-storage, a tool for encoding media.
+// Copyright (C) Brandon Li <https://brandonli.me/>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "chunk_table.h"
+#include "decoder.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+ChunkTable::ChunkTable(const uint32_t shard_count)
+    : shards_(shard_count) {
+    if (shard_count == 0) {
+        throw std::runtime_error("chunk table needs at least one shard");
+    }
+}
+
+ChunkTable::~ChunkTable() = default;
+
+ChunkSlot &ChunkTable::slot(const uint32_t index) {
+    auto &[pages, used] = shards_[shard_of(index)];
+    const uint32_t local = index / shard_count();
+    const std::size_t page = local >> PAGE_SLOTS_LOG2;
+    if (page >= pages.size()) {
+        pages.resize(page + 1);
+    }
+    if (!pages[page]) {
+        pages[page] = std::make_unique<ChunkSlot[]>(std::size_t{PAGE_MASK} + 1);
+    }
+    used = std::max(used, local + 1);
+    return pages[page][local & PAGE_MASK];
+}
+
+const ChunkSlot *ChunkTable::find(const uint32_t index) const {
+    const auto &[pages, used] = shards_[shard_of(index)];
+    const uint32_t local = index / shard_count();
+    if (local >= used) {
+        return nullptr;
+    }
+    const auto &page = pages[local >> PAGE_SLOTS_LOG2];
+    return page ? &page[local & PAGE_MASK] : nullptr;
+}
+
+uint32_t ChunkTable::extent() const {
+    const auto shards = static_cast<uint32_t>(shards_.size());
+    uint32_t extent = 0;
+    for (uint32_t s = 0; s < shards; ++s) {
+        if (shards_[s].used > 0) {
+            extent = std::max(extent, (shards_[s].used - 1) * shards + s + 1);
+        }
+    }
+    return extent;
+}
+
+std::size_t ChunkTable::count(const ChunkState state) const {
+    std::size_t total = 0;
+    for (const auto &[pages, used]: shards_) {
+        for (uint32_t local = 0; local < used; ++local) {
+            if (const auto &page = pages[local >> PAGE_SLOTS_LOG2]) {
+                total += page[local & PAGE_MASK].state == state ? 1 : 0;
+            } else {
+                local |= PAGE_MASK;
+            }
+        }
+    }
+    return total;
+}
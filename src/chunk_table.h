@@ -0,0 +1,100 @@
+/*
+ * This file is part of yt-media-storage, a tool for encoding media.
+ * Copyright (C) Brandon Li <https://brandonli.me/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class ChunkDecoder;
+
+enum class ChunkState : uint8_t {
+    Empty,
+    Partial,
+    Complete,
+};
+
+struct ChunkSlot {
+    ChunkState state = ChunkState::Empty;
+    uint32_t packets_received = 0;
+    std::unique_ptr<ChunkDecoder> codec; // Partial only
+    std::vector<std::byte> data;         // Complete only, and left empty in heal mode
+};
+
+// Per-chunk decode state addressed directly by chunk index. Indices are split across shards
+// by index % shard_count, and each shard keeps its slots in fixed-size pages allocated on first
+// use, so a thread that owns one shard can add and look up chunks without hashing or locking,
+// and a stray high index costs one page rather than a table sized up to it.
+class ChunkTable {
+public:
+    explicit ChunkTable(uint32_t shard_count = 1);
+
+    ~ChunkTable();
+
+    ChunkTable(const ChunkTable &) = delete;
+
+    ChunkTable &operator=(const ChunkTable &) = delete;
+
+    [[nodiscard]] uint32_t shard_count() const { return static_cast<uint32_t>(shards_.size()); }
+
+    [[nodiscard]] uint32_t shard_of(const uint32_t index) const { return index % shard_count(); }
+
+    // Returns the slot for index, allocating its page if needed. References stay valid for the
+    // lifetime of the table.
+    [[nodiscard]] ChunkSlot &slot(uint32_t index);
+
+    [[nodiscard]] const ChunkSlot *find(uint32_t index) const;
+
+    // One past the highest chunk index that has a slot.
+    [[nodiscard]] uint32_t extent() const;
+
+    [[nodiscard]] std::size_t count(ChunkState state) const;
+
+    template<typename Fn>
+    void for_each_in_shard(const uint32_t shard, Fn &&fn) {
+        const auto shards = static_cast<uint32_t>(shards_.size());
+        auto &[pages, used] = shards_[shard];
+        for (uint32_t local = 0; local < used; ++local) {
+            if (const auto &page = pages[local >> PAGE_SLOTS_LOG2]) {
+                fn(local * shards + shard, page[local & PAGE_MASK]);
+            } else {
+                local |= PAGE_MASK;
+            }
+        }
+    }
+
+    template<typename Fn>
+    void for_each(Fn &&fn) {
+        for (uint32_t s = 0; s < shard_count(); ++s) {
+            for_each_in_shard(s, fn);
+        }
+    }
+
+private:
+    static constexpr unsigned PAGE_SLOTS_LOG2 = 10;
+    static constexpr uint32_t PAGE_MASK = (uint32_t{1} << PAGE_SLOTS_LOG2) - 1;
+
+    struct Shard {
+        std::vector<std::unique_ptr<ChunkSlot[]> > pages;
+        uint32_t used = 0;
+    };
+
+    std::vector<Shard> shards_;
+};
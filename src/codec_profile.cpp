@@ -0,0 +1,66 @@
+// This file is part of yt-media-storage, a tool for encoding media.
+// Copyright (C) Brandon Li <https://brandonli.me/>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "codec_profile.h"
+
+#include "configuration.h"
+
+#include <algorithm>
+
+static const std::vector<CodecProfile> profiles = {
+    {
+        "ffv1", "FFV1 lossless (default)", "ffv1", "matroska", "gray",
+        {{"level", "3"}},
+        true, DEFAULT_BITS_PER_BLOCK, 0, COEFFICIENT_STRENGTH,
+    },
+    {
+        "ffvhuff", "FFVHuff lossless, fastest, direct 8-bit pixels", "ffvhuff", "matroska", "gray",
+        {{"pred", "left"}},
+        true, DEFAULT_BITS_PER_BLOCK, 8, COEFFICIENT_STRENGTH,
+    },
+    {
+        "x264-lossless", "H.264 lossless (qp 0), 4 bits per block", "libx264", "matroska", "gray",
+        {{"qp", "0"}, {"preset", "veryfast"}},
+        true, MAX_BITS_PER_BLOCK, 0, COEFFICIENT_STRENGTH,
+    },
+    {
+        "x264-crf", "H.264 CRF 18, small files", "libx264", "matroska", "gray",
+        {{"crf", "18"}, {"preset", "medium"}},
+        false, DEFAULT_BITS_PER_BLOCK, 0, 200.0,
+    },
+    {
+        "x264-444", "H.264 CRF 18 in 4:4:4, room for --chroma", "libx264", "matroska", "yuv444p",
+        {{"crf", "18"}, {"preset", "medium"}},
+        false, DEFAULT_BITS_PER_BLOCK, 0, 200.0,
+    },
+    {
+        "vp9", "VP9 constant quality, smallest files", "libvpx-vp9", "matroska", "yuv420p",
+        {{"crf", "24"}, {"b", "0"}, {"deadline", "good"}, {"cpu-used", "4"}, {"row-mt", "1"}},
+        false, DEFAULT_BITS_PER_BLOCK, 0, 200.0,
+    },
+};
+
+std::span<const CodecProfile> codec_profiles() {
+    return profiles;
+}
+
+const CodecProfile *find_codec_profile(const std::string_view name) {
+    const auto it = std::ranges::find_if(profiles, [name](const CodecProfile &profile) {
+        return profile.name == name;
+    });
+    return it != profiles.end() ? &*it : nullptr;
+}
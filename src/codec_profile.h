@@ -0,0 +1,50 @@
+/*
+ * This file is part of yt-media-storage, a tool for encoding media.
+ * Copyright (C) Brandon Li <https://brandonli.me/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+struct CodecOption {
+    const char *key;
+    const char *value;
+};
+
+// A named encoder setup: codec, container and pixel format, the AVOptions applied to the codec
+// context (and through it the codec's private options), and the embedding defaults that suit
+// it. `lossless` profiles return every pixel exactly and so may carry direct pixel embedding.
+struct CodecProfile {
+    const char *name;
+    const char *description;
+    const char *codec;
+    const char *container;
+    const char *pixel_format;
+    std::vector<CodecOption> options;
+    bool lossless;
+    int bits_per_block;
+    int direct_bits_per_pixel; // nonzero embeds straight into pixels by default
+    double strength; // DCT coefficient strength
+};
+
+[[nodiscard]] std::span<const CodecProfile> codec_profiles();
+
+// nullptr for an unknown name.
+[[nodiscard]] const CodecProfile *find_codec_profile(std::string_view name);
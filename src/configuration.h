@@ -19,15 +19,23 @@
 #pragma once
 #include <cstdint>
 #include <cstdlib>
+#include <numeric>
 #include <string>
 
 // Video Parameters
-constexpr int FRAME_WIDTH = 3840;
-constexpr int FRAME_HEIGHT = 2160;
+constexpr int DEFAULT_FRAME_WIDTH = 3840;
+constexpr int DEFAULT_FRAME_HEIGHT = 2160;
+constexpr int MAX_FRAME_DIMENSION = 8192; // frames are 8 to 8192 pixels a side, in multiples of 8
 constexpr int FRAME_FPS = 30;
 
-const std::string VIDEO_CODEC = "ffv1";
-const std::string VIDEO_CONTAINER = "mkv";
+const std::string DEFAULT_CODEC_PROFILE = "ffv1";
+
+// Audio Parameters
+constexpr int AUDIO_SAMPLE_RATE = 48000;
+constexpr int AUDIO_CHANNELS = 8; // FLAC's limit; every 16-bit sample carries two bytes
+constexpr int AUDIO_SAMPLES_PER_FRAME = AUDIO_SAMPLE_RATE / FRAME_FPS; // one audio frame per video frame
+static_assert(AUDIO_SAMPLE_RATE % FRAME_FPS == 0);
+constexpr char AUDIO_PACKETS_TAG[] = "YTMS_AUDIO_PACKETS"; // marks the audio stream that carries packets
 
 // Encoding Parameters
 constexpr size_t CHUNK_SIZE_BYTES = 1024ull * 1024ull; // 1 MiB
@@ -36,16 +44,37 @@ inline constexpr size_t CHUNK_SIZE_PLAIN_MAX_ENCRYPTED = CHUNK_SIZE_BYTES - 4 -
 constexpr size_t SYMBOL_SIZE_BYTES = 256;
 constexpr double REPAIR_OVERHEAD = 1.00;
 constexpr bool INCLUDE_SOURCE = true;
-constexpr int BITS_PER_BLOCK = 1;
+constexpr uint32_t PARITY_GROUP_SIZE = 16; // sources per XOR parity symbol (FecScheme::Parity)
+constexpr int DEFAULT_BITS_PER_BLOCK = 1;
+constexpr int MAX_BITS_PER_BLOCK = 4; // one per DCT embed position
+constexpr char BITS_PER_BLOCK_TAG[] = "YTMS_BITS_PER_BLOCK"; // video stream tag recording the density
+constexpr char BITS_PER_PIXEL_TAG[] = "YTMS_BITS_PER_PIXEL"; // present instead for direct pixel embedding
+constexpr char CHROMA_PLANES_TAG[] = "YTMS_CHROMA_PLANES"; // present when U and V carry data too
 constexpr double COEFFICIENT_STRENGTH = 150.0;
+constexpr int FFV1_SLICES = 16; // 4x4 slices, each compressed by its own codec thread
+constexpr size_t VIDEO_ENCODE_QUEUE_FRAMES = 4; // frames embedded ahead of the codec
+constexpr size_t STREAM_WRITE_BEHIND_BYTES = 64ull * 1024ull * 1024ull; // muxed ahead of a streamed upload
+
+// Decoding Parameters
+constexpr size_t DECODER_MEMORY_BUDGET_BYTES = 256ull * 1024ull * 1024ull; // buffered symbols before spilling
+constexpr uint32_t MAX_CHUNK_COUNT = 1u << 24; // 16 TiB of 1 MiB chunks; higher indices are rejected
+constexpr uint32_t MAX_ESI_PER_SOURCE = 16; // ESIs at or past k * this are rejected by the decoder
+constexpr uint32_t SOFT_REPAIR_CANDIDATE_BITS = 16; // least confident bits Chase repair may flip
+constexpr uint32_t SOFT_REPAIR_MAX_PATTERNS = 136; // every pattern of up to two of those bits
+constexpr size_t STREAM_READ_AHEAD_BYTES = 64ull * 1024ull * 1024ull; // downloaded ahead of the demuxer
+constexpr size_t STREAM_FETCH_BLOCK_BYTES = 256ull * 1024ull;
+constexpr size_t STREAM_AVIO_BUFFER_BYTES = 64ull * 1024ull;
 
 enum Flags : uint8_t {
     None = 0,
     IsRepairSymbol = 1 << 0,
     LastChunk = 1 << 1,
     Encrypted = 1 << 2,
+    FecSchemeMask = 3 << 3,
 };
 
+constexpr int FEC_SCHEME_SHIFT = 3;
+
 // Header Scheme
 constexpr char SHA_CHARACTERS[] = "0123456789ABCDEF";
 
@@ -90,9 +119,19 @@ constexpr size_t HEADER_SIZE_V2 = CRC_OFF_V2 + CRC_SIZE;
 struct FrameLayout {
     int frame_width;
     int frame_height;
+    int bits_per_pixel; // direct mode: bits stored as the value of each pixel; 0 for DCT embedding
+    int bits_per_block;
     int blocks_per_row;
     int blocks_per_col;
     int total_blocks;
     int bits_per_frame;
     int bytes_per_frame;
+    int chroma_width; // chroma mode: size of the U and V planes, which carry data after the luma; 0 otherwise
+    int chroma_height;
 };
+
+// Smallest run of blocks whose bits fill whole bytes: 8 blocks at 1 or 3 bits per block, 4 at 2
+// and 2 at 4. Frames are embedded and extracted in these groups.
+constexpr int blocks_per_group(const int bits_per_block) {
+    return 8 / std::gcd(8, bits_per_block);
+}
@@ -129,65 +129,63 @@ constexpr float alpha_f(const int u) {
 }
 
 struct PrecomputedBlocks {
-    static constexpr int NUM_PATTERNS = 1 << BITS_PER_BLOCK;
+    static constexpr int NUM_PATTERNS = 1 << MAX_BITS_PER_BLOCK;
     uint8_t patterns[NUM_PATTERNS][8][8];
 };
 
-inline const PrecomputedBlocks &get_precomputed_blocks() {
-    static const PrecomputedBlocks blocks = [] {
-        PrecomputedBlocks result{};
-        const auto &[data] = get_cosine_table();
+// Pattern p drives the first `bits_per_block` embed positions with the bits of p, most
+// significant first, at `strength`; only the first 2^bits_per_block patterns are filled.
+inline PrecomputedBlocks make_precomputed_blocks(const int bits_per_block, const double strength) {
+    PrecomputedBlocks result{};
+    const auto &[data] = get_cosine_table();
+
+    constexpr float dc_value = 0.25f * alpha_f(0) * alpha_f(0) * 64.0f * 128.0f;
 
-        constexpr float dc_value = 0.25f * alpha_f(0) * alpha_f(0) * 64.0f * 128.0f;
+    float dc_image[8][8];
+    for (int x = 0; x < 8; ++x) {
+        for (int y = 0; y < 8; ++y) {
+            dc_image[x][y] = 0.25f * alpha_f(0) * alpha_f(0) * dc_value
+                             * data[x][0] * data[y][0];
+        }
+    }
 
-        float dc_image[8][8];
+    float embed_basis[MAX_BITS_PER_BLOCK][8][8]{};
+    for (int b = 0; b < bits_per_block; ++b) {
+        const auto [u, v] = EMBED_POSITIONS[b];
+        const float scale = 0.25f * alpha_f(u) * alpha_f(v) * static_cast<float>(strength);
         for (int x = 0; x < 8; ++x) {
             for (int y = 0; y < 8; ++y) {
-                dc_image[x][y] = 0.25f * alpha_f(0) * alpha_f(0) * dc_value
-                                 * data[x][0] * data[y][0];
+                embed_basis[b][x][y] = scale * data[x][u] * data[y][v];
             }
         }
+    }
 
-        float embed_basis[4][8][8]{};
-        for (int b = 0; b < BITS_PER_BLOCK; ++b) {
-            const auto [u, v] = EMBED_POSITIONS[b];
-            const float scale = 0.25f * alpha_f(u) * alpha_f(v)
-                                * static_cast<float>(COEFFICIENT_STRENGTH);
+    for (int pattern = 0; pattern < (1 << bits_per_block); ++pattern) {
+        for (int y = 0; y < 8; ++y) {
             for (int x = 0; x < 8; ++x) {
-                for (int y = 0; y < 8; ++y) {
-                    embed_basis[b][x][y] = scale * data[x][u] * data[y][v];
-                }
-            }
-        }
-
-        for (int pattern = 0; pattern < PrecomputedBlocks::NUM_PATTERNS; ++pattern) {
-            for (int y = 0; y < 8; ++y) {
-                for (int x = 0; x < 8; ++x) {
-                    float val = dc_image[y][x];
-                    for (int b = 0; b < BITS_PER_BLOCK; ++b) {
-                        const int bit = (pattern >> (BITS_PER_BLOCK - 1 - b)) & 1;
-                        val += (bit ? 1.0f : -1.0f) * embed_basis[b][y][x];
-                    }
-                    val = std::clamp(val, 0.0f, 255.0f);
-                    result.patterns[pattern][y][x] = static_cast<uint8_t>(val);
+                float val = dc_image[y][x];
+                for (int b = 0; b < bits_per_block; ++b) {
+                    const int bit = (pattern >> (bits_per_block - 1 - b)) & 1;
+                    val += (bit ? 1.0f : -1.0f) * embed_basis[b][y][x];
                 }
+                val = std::clamp(val, 0.0f, 255.0f);
+                result.patterns[pattern][y][x] = static_cast<uint8_t>(val);
             }
         }
+    }
 
-        return result;
-    }();
-    return blocks;
+    return result;
 }
 
 struct DecoderProjections {
-    alignas(32) float vectors[4][64];
+    alignas(32) float vectors[MAX_BITS_PER_BLOCK][64];
 };
 
 inline const DecoderProjections &get_decoder_projections() {
     static const DecoderProjections proj = [] {
         DecoderProjections decoder_projections{};
         const auto &[data] = get_cosine_table();
-        for (int b = 0; b < BITS_PER_BLOCK; ++b) {
+        for (int b = 0; b < MAX_BITS_PER_BLOCK; ++b) {
             const auto [u, v] = EMBED_POSITIONS[b];
             for (int x = 0; x < 8; ++x) {
                 for (int y = 0; y < 8; ++y) {
@@ -199,3 +197,29 @@ inline const DecoderProjections &get_decoder_projections() {
     }();
     return proj;
 }
+
+// Fixed-point form of the embed basis for integer extraction. Position (u, v) weights pixel
+// (x, y) of a block by cos[x][u] * cos[y][v], and the positions only use u, v <= 2, so each pixel
+// row is dotted with a column weight row once and the eight row results are combined with
+// cos[x][1]. Weights are scaled by PROJECTION_WEIGHT_SCALE: small enough that two 8-bit pixels
+// times two weights fit a saturating 16-bit sum, and both rows sum to exactly zero, so the
+// gray level of a block cancels like it does in floating point.
+inline constexpr int PROJECTION_WEIGHT_SCALE = 64;
+
+struct IntegerProjections {
+    alignas(8) int8_t cos1[8]; // cos[i][1]
+    alignas(8) int8_t cos2[8]; // cos[i][2]
+};
+
+inline const IntegerProjections &get_integer_projections() {
+    static const IntegerProjections proj = [] {
+        IntegerProjections integer_projections{};
+        const auto &[data] = get_cosine_table();
+        for (int i = 0; i < 8; ++i) {
+            integer_projections.cos1[i] = static_cast<int8_t>(std::lround(data[i][1] * PROJECTION_WEIGHT_SCALE));
+            integer_projections.cos2[i] = static_cast<int8_t>(std::lround(data[i][2] * PROJECTION_WEIGHT_SCALE));
+        }
+        return integer_projections;
+    }();
+    return proj;
+}
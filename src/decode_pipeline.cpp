@@ -0,0 +1,460 @@
+// This file is part of yt-media-storage, a tool for encoding media.
+// Copyright (C) Brandon Li <https://brandonli.me/>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "decode_pipeline.h"
+#include "spsc_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static constexpr std::size_t PIPELINE_PACKET_QUEUE = 8192; // per shard, about two frames
+static constexpr std::size_t PIPELINE_RESULT_QUEUE = 16;   // per shard
+
+using Clock = std::chrono::steady_clock;
+
+struct DecodePipeline::FrameHold {
+    std::shared_ptr<const std::vector<std::byte> > slab;
+    std::vector<std::byte> spill; // packets from outside the slab, copied once
+    std::atomic<std::size_t> pending{0};
+};
+
+namespace {
+    // Where each chunk's packets sit in the frame sequence. The encoder packs the same number of
+    // whole packets into every frame and writes each chunk's source symbols before its repair
+    // symbols, so packet n of the stream lands in frame n / packets_per_frame. Re-encoded or
+    // trimmed videos break that, so the index is only trusted after the frames it has checked
+    // agree with it, and is dropped for good on the first mismatch.
+    class FrameIndex {
+    public:
+        void observe(const int64_t frame, const std::span<const std::byte> first_packet,
+                     const std::size_t packets_per_frame) {
+            if (broken_ || frame < 0 || packets_per_frame == 0 || !Decoder::validate_raw_packet_crc(first_packet)) {
+                return;
+            }
+            const auto packet = Decoder::parse_packet(first_packet);
+            const auto fec = packet ? fec_scheme_from_flags(packet->header.flags) : std::nullopt;
+            if (!fec) {
+                return;
+            }
+            const PacketHeader &hdr = packet->header;
+
+            // The last chunk may be short, so only full chunks define the stride.
+            if ((hdr.flags & LastChunk) == 0) {
+                const uint64_t per_chunk = hdr.k + fec_repair_count(*fec, hdr.k);
+                if (packets_per_chunk_ != 0 && packets_per_chunk_ != per_chunk) {
+                    broken_ = true;
+                    return;
+                }
+                packets_per_chunk_ = per_chunk;
+                source_per_chunk_ = hdr.k;
+            }
+            if (packets_per_chunk_ == 0) {
+                return;
+            }
+            if (hdr.esi >= packets_per_chunk_ ||
+                static_cast<uint64_t>(hdr.chunk_index) * packets_per_chunk_ + hdr.esi !=
+                static_cast<uint64_t>(frame) * packets_per_frame) {
+                broken_ = true;
+                return;
+            }
+            packets_per_frame_ = packets_per_frame;
+            ++confirmations_;
+        }
+
+        [[nodiscard]] bool usable() const { return !broken_ && confirmations_ >= 2; }
+
+        // The chunk whose repair symbols `frame` starts with, if it starts past that chunk's sources.
+        [[nodiscard]] std::optional<uint32_t> repair_chunk_at(const int64_t frame) const {
+            const uint64_t packet = static_cast<uint64_t>(frame) * packets_per_frame_;
+            if (packet % packets_per_chunk_ < source_per_chunk_) {
+                return std::nullopt;
+            }
+            return static_cast<uint32_t>(packet / packets_per_chunk_);
+        }
+
+        // First frame at or after `frame` that holds a packet of a chunk not yet complete.
+        [[nodiscard]] int64_t next_needed_frame(const int64_t frame, const Decoder &decoder) const {
+            auto chunk = static_cast<uint64_t>(frame) * packets_per_frame_ / packets_per_chunk_;
+            while (chunk < MAX_CHUNK_COUNT && decoder.is_chunk_complete(static_cast<uint32_t>(chunk))) {
+                ++chunk;
+            }
+            return std::max(frame, static_cast<int64_t>(chunk * packets_per_chunk_ / packets_per_frame_));
+        }
+
+    private:
+        uint64_t packets_per_chunk_ = 0;
+        uint64_t source_per_chunk_ = 0;
+        uint64_t packets_per_frame_ = 0;
+        int confirmations_ = 0;
+        bool broken_ = false;
+    };
+}
+
+DecodePipeline::DecodePipeline(Decoder &decoder)
+    : decoder_(decoder) {
+}
+
+uint32_t DecodePipeline::default_shards() {
+    // The reader keeps the OpenMP team busy with extraction, so leave it most of the cores.
+    return std::clamp(std::thread::hardware_concurrency() / 2, 1u, 8u);
+}
+
+void DecodePipeline::run(VideoDecoder &video, const FrameObserver &on_frame, const PacketObserver &on_packet,
+                         const ChunkSink &on_chunk) {
+    VideoDecoder *const videos[] = {&video};
+    run(videos, on_frame, on_packet, on_chunk);
+}
+
+void DecodePipeline::run(const std::span<VideoDecoder *const> videos, const FrameObserver &on_frame,
+                         const PacketObserver &on_packet, const ChunkSink &on_chunk) {
+    const uint32_t shards = decoder_.shard_count();
+    const std::size_t readers = videos.size();
+
+    // Every reader gets its own queue to every shard, so each queue keeps a single producer.
+    // A worker drains all of its queues and sleeps on one signal they share.
+    struct alignas(64) ShardSignal {
+        std::atomic<uint32_t> value{0};
+    };
+    std::vector<ShardSignal> shard_signals(shards);
+    std::vector<std::vector<std::unique_ptr<SpscQueue<PacketSlot> > > > inboxes(readers);
+    for (auto &reader_inboxes: inboxes) {
+        for (uint32_t s = 0; s < shards; ++s) {
+            reader_inboxes.push_back(
+                std::make_unique<SpscQueue<PacketSlot> >(PIPELINE_PACKET_QUEUE, &shard_signals[s].value));
+        }
+    }
+    std::vector<std::unique_ptr<SpscQueue<ChunkDecodeResult> > > outboxes;
+    for (uint32_t s = 0; s < shards; ++s) {
+        outboxes.push_back(std::make_unique<SpscQueue<ChunkDecodeResult> >(PIPELINE_RESULT_QUEUE));
+    }
+
+    // After the first failure every stage keeps draining its input without doing work, so no
+    // thread is left blocked on a full queue while the others shut down.
+    std::atomic<bool> failed{false};
+    std::vector<std::exception_ptr> errors(shards + 1 + readers);
+    std::atomic<uint32_t> results_signal{0};
+    std::atomic<uint32_t> workers_running{shards};
+    struct alignas(64) Progress {
+        std::atomic<uint64_t> processed{0};
+    };
+    // Indexed [reader * shards + shard], so a reader can wait for a shard to catch up with it.
+    std::vector<Progress> progress(readers * shards);
+    std::vector<Clock::duration> busy(shards);
+    const auto fail = [&failed, &errors](const std::size_t stage) {
+        errors[stage] = std::current_exception();
+        failed.store(true, std::memory_order_release);
+    };
+    const auto wake_writer = [&results_signal] {
+        results_signal.fetch_add(1, std::memory_order_release);
+        results_signal.notify_one();
+    };
+
+    // Per reader, declared before the threads so they outlive every queued view into them.
+    std::vector<std::vector<std::unique_ptr<FrameHold> > > frame_holds(readers);
+
+    std::vector<std::jthread> workers;
+    workers.reserve(shards);
+    for (uint32_t s = 0; s < shards; ++s) {
+        workers.emplace_back([&, s] {
+            auto &outbox = *outboxes[s];
+            std::size_t source = 0;
+            const auto process = [&](const PacketSlot &slot) {
+                if (!failed.load(std::memory_order_acquire)) {
+                    const auto started = Clock::now();
+                    try {
+                        auto result = decoder_.process_packet(slot.packet);
+                        if (result && result->success) {
+                            outbox.push([&result](ChunkDecodeResult &out) { out = std::move(*result); });
+                            wake_writer();
+                        }
+                    } catch (...) {
+                        fail(s);
+                    }
+                    busy[s] += Clock::now() - started;
+                }
+                slot.frame->pending.fetch_sub(1, std::memory_order_release);
+                progress[source * shards + s].processed.fetch_add(1, std::memory_order_release);
+            };
+            while (true) {
+                const uint32_t seen = shard_signals[s].value.load(std::memory_order_acquire);
+                bool processed = false;
+                for (source = 0; source < readers; ++source) {
+                    while (inboxes[source][s]->try_pop(process)) {
+                        processed = true;
+                    }
+                }
+                if (processed) {
+                    continue;
+                }
+                if (std::ranges::all_of(inboxes, [s](const auto &reader_inboxes) {
+                    return reader_inboxes[s]->drained();
+                })) {
+                    break;
+                }
+                shard_signals[s].value.wait(seen, std::memory_order_acquire);
+            }
+            outbox.close();
+            workers_running.fetch_sub(1, std::memory_order_release);
+            wake_writer();
+        });
+    }
+
+    Clock::duration write_time{};
+    std::jthread writer([&] {
+        const auto deliver = [&](ChunkDecodeResult &result) {
+            if (failed.load(std::memory_order_acquire)) {
+                return;
+            }
+            const auto started = Clock::now();
+            try {
+                on_chunk(std::move(result));
+            } catch (...) {
+                fail(shards);
+            }
+            result = {};
+            write_time += Clock::now() - started;
+        };
+        while (true) {
+            const uint32_t seen = results_signal.load(std::memory_order_acquire);
+            bool delivered = false;
+            for (const auto &outbox: outboxes) {
+                while (outbox->try_pop(deliver)) {
+                    delivered = true;
+                }
+            }
+            if (delivered) {
+                continue;
+            }
+            if (workers_running.load(std::memory_order_acquire) == 0 &&
+                std::ranges::all_of(outboxes, [](const auto &outbox) { return outbox->drained(); })) {
+                break;
+            }
+            results_signal.wait(seen, std::memory_order_acquire);
+        }
+    });
+
+    struct ReaderStats {
+        Clock::duration read_time{};
+        int64_t frames_skipped = 0;
+        bool stopped_early = false;
+    };
+    std::vector<ReaderStats> reader_stats(readers);
+    // Readers share the observers, so with several inputs each frame's callbacks run under a lock.
+    std::mutex observer_mutex;
+    // File id of the first input to yield a valid packet; every other input must match it.
+    std::optional<Decoder::FileId> input_file_id;
+    std::size_t input_file_owner = 0;
+    std::mutex file_id_mutex;
+    const auto check_file_id = [&](const std::size_t r, const std::span<const std::byte> packet) {
+        Decoder::FileId file_id{};
+        std::memcpy(file_id.data(), packet.data() + FILE_ID_OFF, FILE_ID_SIZE);
+        const std::lock_guard lock(file_id_mutex);
+        if (!input_file_id) {
+            input_file_id = file_id;
+            input_file_owner = r;
+        } else if (*input_file_id != file_id) {
+            throw std::runtime_error("input " + std::to_string(r + 1) + " holds a different file than input " +
+                                     std::to_string(input_file_owner + 1));
+        }
+    };
+#ifdef _OPENMP
+    const int extraction_threads = std::max(1, omp_get_max_threads() / static_cast<int>(readers));
+#endif
+
+    const auto read_video = [&](const std::size_t r) {
+        VideoDecoder &video = *videos[r];
+        ReaderStats &stats = reader_stats[r];
+        std::vector<uint64_t> pushed(shards, 0);
+        FrameIndex index;
+        bool skipping = skip_repair_frames_;
+        int64_t last_seek = -1;
+        int64_t seek_pending = -1;
+        bool file_checked = false;
+#ifdef _OPENMP
+        if (readers > 1) {
+            omp_set_num_threads(extraction_threads);
+        }
+#endif
+        auto &holds = frame_holds[r];
+        // Hands back a hold no queued packet points into any more, after letting go of the slab
+        // of every finished frame so the video decoder can extract into it again.
+        const auto release_finished = [&holds]() -> FrameHold * {
+            FrameHold *free = nullptr;
+            for (const auto &hold: holds) {
+                if (hold->pending.load(std::memory_order_acquire) == 0) {
+                    hold->slab.reset();
+                    free = free ? free : hold.get();
+                }
+            }
+            return free;
+        };
+        try {
+            while (!video.is_eof() && !failed.load(std::memory_order_acquire)) {
+                FrameHold *hold = release_finished();
+                if (decoder_.all_chunks_complete()) {
+                    stats.stopped_early = true;
+                    break;
+                }
+                if (skipping && index.usable() && video.current_frame() >= 0) {
+                    const int64_t next = video.current_frame() + 1;
+                    // About to read repair symbols: let the chunk's shard catch up first, since it
+                    // may only be a few queued source packets away from finishing the chunk.
+                    if (const auto chunk = index.repair_chunk_at(next);
+                        chunk && !decoder_.is_chunk_complete(*chunk)) {
+                        const uint32_t shard = decoder_.shard_for_chunk(*chunk);
+                        while (progress[r * shards + shard].processed.load(std::memory_order_acquire) <
+                               pushed[shard] && !failed.load(std::memory_order_acquire)) {
+                            std::this_thread::yield();
+                        }
+                    }
+                    // Only ever seek forward past the last target, so a container that lands a few
+                    // frames early cannot bounce the reader back to the same target forever.
+                    if (const int64_t target = index.next_needed_frame(next, decoder_);
+                        target > next && target > last_seek && video.seek_to_frame(target)) {
+                        stats.frames_skipped += target - next;
+                        last_seek = seek_pending = target;
+                    }
+                }
+
+                const auto read_started = Clock::now();
+                const auto &packets = video.decode_next_frame();
+                stats.read_time += Clock::now() - read_started;
+                if (seek_pending >= 0 && video.current_frame() >= 0) {
+                    if (video.current_frame() > seek_pending) {
+                        // Landed past the target: the skipped-over frames are unaccounted for, so go
+                        // back and read the rest of the video sequentially.
+                        skipping = false;
+                        video.seek_to_frame(seek_pending);
+                        seek_pending = -1;
+                        continue;
+                    }
+                    seek_pending = -1;
+                }
+                if (!file_checked) {
+                    for (const auto &packet: packets) {
+                        if (packet.size() >= HEADER_SIZE && Decoder::validate_raw_packet_crc(packet)) {
+                            check_file_id(r, packet);
+                            file_checked = true;
+                            break;
+                        }
+                    }
+                }
+                if (skipping && !packets.empty()) {
+                    index.observe(video.current_frame(), packets.front(),
+                                  video.packets_per_frame(packets.front().size()));
+                }
+                {
+                    std::unique_lock lock(observer_mutex, std::defer_lock);
+                    if (readers > 1) {
+                        lock.lock();
+                    }
+                    on_frame(r, packets.size());
+                    for (const auto &packet: packets) {
+                        on_packet(packet);
+                    }
+                }
+                if (packets.empty()) {
+                    continue;
+                }
+                if (!hold) {
+                    hold = holds.emplace_back(std::make_unique<FrameHold>()).get();
+                }
+                hold->slab = video.frame_slab();
+                const std::span<const std::byte> slab(*hold->slab);
+                const auto in_slab = [&slab](const std::span<const std::byte> packet) {
+                    return packet.data() >= slab.data() && packet.data() + packet.size() <= slab.data() + slab.size();
+                };
+                // Audio track packets live in a buffer the next frame overwrites, so only those are
+                // copied; the spill is sized up front so the views into it stay put.
+                std::size_t spill = 0;
+                for (const auto &packet: packets) {
+                    spill += in_slab(packet) ? 0 : packet.size();
+                }
+                hold->spill.clear();
+                hold->spill.reserve(spill);
+                hold->pending.store(packets.size(), std::memory_order_relaxed);
+                for (auto packet: packets) {
+                    if (!in_slab(packet)) {
+                        const std::size_t offset = hold->spill.size();
+                        hold->spill.insert(hold->spill.end(), packet.begin(), packet.end());
+                        packet = std::span<const std::byte>(hold->spill).subspan(offset, packet.size());
+                    }
+                    const uint32_t shard = decoder_.shard_for_packet(packet);
+                    inboxes[r][shard]->push([packet, hold](PacketSlot &slot) {
+                        slot.packet = packet;
+                        slot.frame = hold;
+                    });
+                    ++pushed[shard];
+                }
+            }
+        } catch (...) {
+            fail(shards + 1 + r);
+        }
+        for (const auto &inbox: inboxes[r]) {
+            inbox->close();
+        }
+    };
+
+    // The first input is read on the calling thread, any others on their own threads, all at
+    // once: whichever copy is faster or cleaner completes more chunks, and every reader stops
+    // as soon as the file is complete.
+    {
+        std::vector<std::jthread> extra_readers;
+        for (std::size_t r = 1; r < readers; ++r) {
+            extra_readers.emplace_back(read_video, r);
+        }
+        if (readers > 0) {
+            read_video(0);
+        }
+    }
+    for (auto &worker: workers) {
+        worker.join();
+    }
+    writer.join();
+
+    const auto seconds = [](const Clock::duration d) { return std::chrono::duration<double>(d).count(); };
+    stage_times_ = {0, 0, seconds(write_time)};
+    frames_skipped_ = 0;
+    stopped_early_ = false;
+    for (const auto &stats: reader_stats) {
+        stage_times_.read_seconds += seconds(stats.read_time);
+        frames_skipped_ += stats.frames_skipped;
+        stopped_early_ = stopped_early_ || stats.stopped_early;
+    }
+    for (const auto &shard_busy: busy) {
+        stage_times_.fec_seconds += seconds(shard_busy);
+    }
+
+    for (const auto &error: errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * This file is part of yt-media-storage, a tool for encoding media.
+ * Copyright (C) Brandon Li <https://brandonli.me/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+
+#include "configuration.h"
+#include "decoder.h"
+#include "video_decoder.h"
+
+// Threaded restore: one reader per input video demuxes, decodes and extracts frames (extraction
+// is already spread over the OpenMP team), packets are routed by chunk_index % shards to one
+// worker per decoder shard, and completed chunks go to a single writer thread. Stages are
+// connected by SPSC queues, so no stage takes a lock on the per-packet path. Packets travel as
+// views into the frame slab they were extracted into, which the video decoder sets aside until
+// every shard is done with it, so frames in flight are bounded by the queue sizes.
+class DecodePipeline {
+public:
+    // `source` is the index of the input video the frame came from.
+    using FrameObserver = std::function<void(std::size_t source, std::size_t packets)>;
+    using PacketObserver = std::function<void(std::span<const std::byte> packet)>;
+    using ChunkSink = std::function<void(ChunkDecodeResult &&result)>;
+
+    // The decoder's shard count decides how many worker threads run.
+    explicit DecodePipeline(Decoder &decoder);
+
+    // Reads video to the end. on_frame and on_packet run on the calling thread, on_chunk on the
+    // writer thread. The first exception thrown by any stage is rethrown once all threads stop.
+    void run(VideoDecoder &video, const FrameObserver &on_frame, const PacketObserver &on_packet,
+             const ChunkSink &on_chunk);
+
+    // Union decode: reads several copies of the same file into the one decoder at once, each on
+    // its own reader thread, until every chunk is complete or every input is exhausted. on_frame
+    // and on_packet then run on the reader threads, one frame at a time.
+    void run(std::span<VideoDecoder *const> videos, const FrameObserver &on_frame, const PacketObserver &on_packet,
+             const ChunkSink &on_chunk);
+
+    // Seek past runs of frames that only hold packets of already completed chunks (on a clean
+    // channel, the repair half of every chunk). Only used once the frame layout has been
+    // confirmed against the packets actually read.
+    void set_skip_repair_frames(const bool skip) { skip_repair_frames_ = skip; }
+
+    // True if reading stopped before the end because every chunk was complete.
+    [[nodiscard]] bool stopped_early() const { return stopped_early_; }
+
+    [[nodiscard]] int64_t frames_skipped() const { return frames_skipped_; }
+
+    // Time spent in each stage during run(): demux, decode and extraction on the reader, FEC
+    // summed over all worker shards, and the chunk sink on the writer.
+    struct StageTimes {
+        double read_seconds = 0;
+        double fec_seconds = 0;
+        double write_seconds = 0;
+    };
+
+    [[nodiscard]] const StageTimes &stage_times() const { return stage_times_; }
+
+    [[nodiscard]] static uint32_t default_shards();
+
+private:
+    // Keeps one frame's packets alive until every shard has processed them.
+    struct FrameHold;
+
+    // Queues carry views, not copies: a packet points into its reader's frame slab (or, for
+    // audio track packets, into the hold), which the hold keeps from being reused.
+    struct PacketSlot {
+        std::span<const std::byte> packet;
+        FrameHold *frame = nullptr;
+    };
+
+    Decoder &decoder_;
+    bool skip_repair_frames_ = false;
+    bool stopped_early_ = false;
+    int64_t frames_skipped_ = 0;
+    StageTimes stage_times_{};
+};
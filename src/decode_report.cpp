@@ -0,0 +1,207 @@
+// This file is part of yt-media-storage, a tool for encoding media.
+// Copyright (C) Brandon Li <https://brandonli.me/>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "decode_report.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+
+static std::string json_escape(const std::string &text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (const char c: text) {
+        switch (c) {
+            case '"': escaped += "\\\"";
+                break;
+            case '\\': escaped += "\\\\";
+                break;
+            case '\n': escaped += "\\n";
+                break;
+            case '\t': escaped += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    constexpr char hex[] = "0123456789abcdef";
+                    escaped += "\\u00";
+                    escaped += hex[(c >> 4) & 0xF];
+                    escaped += hex[c & 0xF];
+                } else {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
+}
+
+template<typename T>
+static T read_field(const std::span<const std::byte> packet, const std::size_t offset) {
+    T value{};
+    std::memcpy(&value, packet.data() + offset, sizeof(value));
+    return value;
+}
+
+void DecodeReport::finish_frame() {
+    if (current_.crc_failures > 0) {
+        failed_frames_.push_back(current_);
+    }
+}
+
+void DecodeReport::begin_frame(const std::size_t source, const int64_t frame, const VideoDecoder::FrameStats &stats) {
+    if (frames_ > 0) {
+        finish_frame();
+    }
+    ++frames_;
+    if (source >= source_frames_.size()) {
+        source_frames_.resize(source + 1);
+    }
+    const auto fallback = static_cast<int64_t>(source_frames_[source]++);
+    current_ = {source, frame >= 0 ? frame : fallback, 0, 0};
+    framing_.pilot_bits += stats.pilot_bits;
+    framing_.pilot_bit_errors += stats.pilot_bit_errors;
+    framing_.bad_magic += stats.bad_magic;
+    framing_.resyncs += stats.resyncs;
+    framing_.bytes_discarded += stats.bytes_discarded;
+    framing_.soft_repaired += stats.soft_repaired;
+    framing_.audio_packets += stats.audio_packets;
+}
+
+void DecodeReport::add_packet(const std::span<const std::byte> packet) {
+    ++packets_;
+    ++current_.packets;
+    if (!Decoder::validate_raw_packet_crc(packet)) {
+        ++crc_failures_;
+        ++current_.crc_failures;
+        return;
+    }
+
+    const auto chunk_index = read_field<uint32_t>(packet, CHUNK_INDEX_OFF);
+    if (chunk_index >= MAX_CHUNK_COUNT) {
+        return;
+    }
+    if (chunk_index >= chunks_.size()) {
+        chunks_.resize(chunk_index + 1);
+    }
+    ChunkStats &chunk = chunks_[chunk_index];
+    chunk.k = read_field<uint32_t>(packet, K_OFF);
+    const auto esi = read_field<uint32_t>(packet, ESI_OFF);
+    if (esi >= static_cast<std::size_t>(chunk.k) * MAX_ESI_PER_SOURCE) {
+        return;
+    }
+    if (esi / 64 >= chunk.seen.size()) {
+        chunk.seen.resize(esi / 64 + 1, 0);
+    }
+    const uint64_t bit = uint64_t{1} << (esi % 64);
+    if ((chunk.seen[esi / 64] & bit) != 0) {
+        ++chunk.duplicates;
+        return;
+    }
+    chunk.seen[esi / 64] |= bit;
+    ++chunk.received;
+    if (esi < chunk.k) {
+        ++chunk.source_received;
+    }
+    if ((static_cast<uint8_t>(packet[FLAGS_OFF]) & LastChunk) != 0) {
+        found_last_chunk_ = true;
+        last_chunk_index_ = chunk_index;
+    }
+}
+
+void DecodeReport::write(std::ostream &out, const Decoder &decoder) const {
+    std::vector<FrameFailures> failed_frames = failed_frames_;
+    if (frames_ > 0 && current_.crc_failures > 0) {
+        failed_frames.push_back(current_);
+    }
+
+    const auto expected = static_cast<std::size_t>(
+        found_last_chunk_ ? last_chunk_index_ + 1 : static_cast<uint32_t>(chunks_.size()));
+    int64_t min_margin = std::numeric_limits<int64_t>::max();
+    std::size_t unrecoverable = 0;
+
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out << std::fixed << std::setprecision(6);
+
+    out << "{\n  \"inputs\": [";
+    for (std::size_t i = 0; i < inputs_.size(); ++i) {
+        out << (i == 0 ? "" : ", ") << "\"" << json_escape(inputs_[i]) << "\"";
+    }
+    out << "],\n"
+        << "  \"frames\": {\"read\": " << frames_read_ << ", \"skipped\": " << frames_skipped_
+        << ", \"stopped_early\": " << (stopped_early_ ? "true" : "false") << "},\n"
+        << "  \"packets\": {\"extracted\": " << packets_ << ", \"crc_failures\": " << crc_failures_
+        << ", \"soft_repaired\": " << framing_.soft_repaired
+        << ", \"from_audio\": " << framing_.audio_packets
+        << ", \"skipped_completed\": " << decoder.packets_skipped_completed() << "},\n"
+        << "  \"framing\": {\"bad_magic\": " << framing_.bad_magic << ", \"resyncs\": " << framing_.resyncs
+        << ", \"bytes_discarded\": " << framing_.bytes_discarded << "},\n"
+        << "  \"pilots\": {\"bits\": " << framing_.pilot_bits << ", \"bit_errors\": " << framing_.pilot_bit_errors
+        << ", \"ber\": " << (framing_.pilot_bits > 0
+                                 ? static_cast<double>(framing_.pilot_bit_errors) /
+                                   static_cast<double>(framing_.pilot_bits)
+                                 : 0.0) << "},\n";
+
+    out << "  \"chunks\": [";
+    for (std::size_t index = 0; index < expected; ++index) {
+        static const ChunkStats missing{};
+        const ChunkStats &stats = index < chunks_.size() ? chunks_[index] : missing;
+        const bool complete = decoder.is_chunk_complete(static_cast<uint32_t>(index));
+        if (!complete) {
+            ++unrecoverable;
+        }
+        out << (index == 0 ? "\n" : ",\n")
+            << "    {\"index\": " << index << ", \"k\": " << stats.k << ", \"received\": " << stats.received
+            << ", \"source_received\": " << stats.source_received << ", \"duplicates\": " << stats.duplicates
+            << ", \"margin\": ";
+        // Symbols received beyond the k needed; unknown for a chunk no valid packet arrived for.
+        if (stats.k > 0) {
+            const int64_t margin = static_cast<int64_t>(stats.received) - static_cast<int64_t>(stats.k);
+            min_margin = std::min(min_margin, margin);
+            out << margin;
+        } else {
+            out << "null";
+        }
+        out << ", \"complete\": " << (complete ? "true" : "false") << "}";
+    }
+    out << (expected > 0 ? "\n  ],\n" : "],\n");
+
+    out << "  \"summary\": {\"expected_chunks\": " << expected << ", \"complete_chunks\": "
+        << expected - unrecoverable << ", \"min_margin\": ";
+    if (min_margin == std::numeric_limits<int64_t>::max()) {
+        out << "null";
+    } else {
+        out << min_margin;
+    }
+    out << "},\n";
+
+    out << "  \"crc_failures_per_frame\": [";
+    for (std::size_t i = 0; i < failed_frames.size(); ++i) {
+        out << (i == 0 ? "" : ", ") << "{\"input\": " << failed_frames[i].source
+            << ", \"frame\": " << failed_frames[i].frame << ", \"packets\": "
+            << failed_frames[i].packets << ", \"crc_failures\": " << failed_frames[i].crc_failures << "}";
+    }
+    out << "],\n";
+
+    out << "  \"stage_seconds\": {";
+    for (std::size_t i = 0; i < stages_.size(); ++i) {
+        out << (i == 0 ? "" : ", ") << "\"" << json_escape(stages_[i].first) << "\": " << stages_[i].second;
+    }
+    out << "}\n}\n";
+
+    out.flags(flags);
+    out.precision(precision);
+}
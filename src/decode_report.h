@@ -0,0 +1,89 @@
+/*
+ * This file is part of yt-media-storage, a tool for encoding media.
+ * Copyright (C) Brandon Li <https://brandonli.me/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "decoder.h"
+#include "video_decoder.h"
+
+// Collects framing, CRC and per-chunk redundancy statistics while a video is read, and writes
+// them as JSON. begin_frame() and add_packet() must not be called concurrently, and the packets of
+// a frame must directly follow its begin_frame(); `source` indexes the inputs. Every packet is
+// CRC-checked here as well, so only attach a report when one is wanted.
+class DecodeReport {
+public:
+    void begin_frame(std::size_t source, int64_t frame, const VideoDecoder::FrameStats &stats);
+
+    void add_packet(std::span<const std::byte> packet);
+
+    void set_inputs(std::vector<std::string> paths) { inputs_ = std::move(paths); }
+
+    void set_frames(const int64_t read, const int64_t skipped, const bool stopped_early) {
+        frames_read_ = read;
+        frames_skipped_ = skipped;
+        stopped_early_ = stopped_early;
+    }
+
+    void add_stage(std::string name, const double seconds) { stages_.emplace_back(std::move(name), seconds); }
+
+    // Chunk totals and completion come from the decoder the packets were fed to.
+    void write(std::ostream &out, const Decoder &decoder) const;
+
+private:
+    struct ChunkStats {
+        uint32_t k = 0;
+        uint32_t received = 0;        // distinct CRC-valid ESIs, including those after the chunk completed
+        uint32_t source_received = 0;
+        uint32_t duplicates = 0;      // repeats of an ESI already counted, e.g. from another input
+        std::vector<uint64_t> seen;   // one bit per ESI
+    };
+
+    struct FrameFailures {
+        std::size_t source = 0;
+        int64_t frame = 0;
+        std::size_t packets = 0;
+        std::size_t crc_failures = 0;
+    };
+
+    std::vector<std::string> inputs_;
+    int64_t frames_read_ = 0;
+    int64_t frames_skipped_ = 0;
+    bool stopped_early_ = false;
+    std::vector<std::pair<std::string, double> > stages_;
+
+    std::size_t frames_ = 0;
+    std::vector<std::size_t> source_frames_;
+    std::size_t packets_ = 0;
+    std::size_t crc_failures_ = 0;
+    VideoDecoder::FrameStats framing_{};
+    FrameFailures current_{};
+    std::vector<FrameFailures> failed_frames_;
+    std::vector<ChunkStats> chunks_;
+    bool found_last_chunk_ = false;
+    uint32_t last_chunk_index_ = 0;
+
+    void finish_frame();
+};
@@ -18,24 +18,12 @@
 
 #include "configuration.h"
 #include "crypto.h"
-#include "libs/wirehair/wirehair.h"
 
 #include <algorithm>
 #include <cstring>
-#include <mutex>
 #include <ranges>
 #include <stdexcept>
 
-static std::once_flag ensure_init;
-
-static void ensureWirehairInit() {
-    std::call_once(ensure_init, [] {
-        if (const WirehairResult result = wirehair_init(); result != Wirehair_Success) {
-            throw std::runtime_error("wirehair_init failed");
-        }
-    });
-}
-
 static uint8_t readByte(std::span<const std::byte> buffer, const std::size_t offset) {
     return static_cast<uint8_t>(buffer[offset]);
 }
@@ -53,23 +41,25 @@ static uint32_t readU32LE(const std::span<const std::byte> buffer, const std::si
 }
 
 ChunkDecoder::ChunkDecoder(const uint32_t chunk_index, const uint32_t chunk_size, const uint32_t k,
-                           const uint16_t symbol_size)
+                           const uint16_t symbol_size, SymbolArena &arena, const FecScheme fec)
     : chunk_index_(chunk_index)
       , chunk_size_(chunk_size)
       , k_(k)
-      , symbol_size_(symbol_size) {
-    ensureWirehairInit();
-    codec_ = wirehair_decoder_create(nullptr, chunk_size_, symbol_size_);
-    if (!codec_) {
-        throw std::runtime_error("wirehair_decoder_create failed");
-    }
+      , symbol_size_(symbol_size)
+      , arena_(&arena)
+      , fec_(fec) {
+    if (symbol_size_ == 0 || chunk_size_ == 0 || symbol_size_ != arena.symbol_bytes() ||
+        k_ != (static_cast<uint64_t>(chunk_size_) + symbol_size_ - 1) / symbol_size_) {
+        throw std::runtime_error("invalid chunk geometry");
+    }
+    // One flag per ESI drops the duplicates that arrive when several copies of a video are merged.
+    // Sized for this build's repair count plus one (older encoders numbered ESIs from 1) and grown
+    // in add_packet for videos written with a larger REPAIR_OVERHEAD.
+    symbol_present_.assign(static_cast<std::size_t>(k_) + fec_repair_count(fec_, k_) + 1, 0);
 }
 
 ChunkDecoder::~ChunkDecoder() {
-    if (codec_) {
-        wirehair_free(static_cast<WirehairCodec>(codec_));
-        codec_ = nullptr;
-    }
+    release_buffered();
 }
 
 ChunkDecoder::ChunkDecoder(ChunkDecoder &&other) noexcept
@@ -77,71 +67,167 @@ ChunkDecoder::ChunkDecoder(ChunkDecoder &&other) noexcept
       , chunk_size_(other.chunk_size_)
       , k_(other.k_)
       , symbol_size_(other.symbol_size_)
-      , codec_(other.codec_)
+      , arena_(other.arena_)
+      , fec_(other.fec_)
+      , codec_(std::move(other.codec_))
       , decoded_(other.decoded_)
+      , retain_codec_(other.retain_codec_)
       , packets_received_(other.packets_received_)
+      , source_received_(other.source_received_)
+      , resident_symbols_(other.resident_symbols_)
+      , last_used_(other.last_used_)
+      , symbol_present_(std::move(other.symbol_present_))
+      , buffered_(std::move(other.buffered_))
       , decoded_data_(std::move(other.decoded_data_)) {
-    other.codec_ = nullptr;
+    other.buffered_.clear();
+    other.resident_symbols_ = 0;
 }
 
 ChunkDecoder &ChunkDecoder::operator=(ChunkDecoder &&other) noexcept {
     if (this != &other) {
-        if (codec_) {
-            wirehair_free(static_cast<WirehairCodec>(codec_));
-        }
+        release_buffered();
         chunk_index_ = other.chunk_index_;
         chunk_size_ = other.chunk_size_;
         k_ = other.k_;
         symbol_size_ = other.symbol_size_;
-        codec_ = other.codec_;
+        arena_ = other.arena_;
+        fec_ = other.fec_;
+        codec_ = std::move(other.codec_);
         decoded_ = other.decoded_;
+        retain_codec_ = other.retain_codec_;
         packets_received_ = other.packets_received_;
+        source_received_ = other.source_received_;
+        resident_symbols_ = other.resident_symbols_;
+        last_used_ = other.last_used_;
+        symbol_present_ = std::move(other.symbol_present_);
+        buffered_ = std::move(other.buffered_);
         decoded_data_ = std::move(other.decoded_data_);
-        other.codec_ = nullptr;
+        other.buffered_.clear();
+        other.resident_symbols_ = 0;
     }
     return *this;
 }
 
-bool ChunkDecoder::add_packet(const uint32_t esi, const std::span<const std::byte> payload) {
-    if (decoded_) {
-        return true;
+void ChunkDecoder::release_buffered() {
+    for (const auto &[esi, slot, spilled]: buffered_) {
+        if (spilled) {
+            arena_->release_spilled(slot);
+        } else {
+            arena_->release(slot);
+        }
     }
+    buffered_.clear();
+    buffered_.shrink_to_fit();
+    resident_symbols_ = 0;
+}
+
+void ChunkDecoder::spill_symbols() {
+    for (auto &symbol: buffered_) {
+        if (!symbol.spilled) {
+            symbol.slot = arena_->spill(symbol.slot);
+            symbol.spilled = true;
+        }
+    }
+    resident_symbols_ = 0;
+}
+
+std::span<const std::byte> ChunkDecoder::read_symbol(const BufferedSymbol &symbol,
+                                                     const std::span<std::byte> scratch) const {
+    if (!symbol.spilled) {
+        return arena_->view(symbol.slot);
+    }
+    arena_->load_spilled(symbol.slot, scratch);
+    return scratch;
+}
+
+bool ChunkDecoder::assemble_from_sources() {
+    decoded_data_.resize(chunk_size_);
+    std::vector<std::byte> scratch(symbol_size_);
+    for (const auto &symbol: buffered_) {
+        if (symbol.esi >= k_) {
+            continue;
+        }
+        const std::size_t offset = static_cast<std::size_t>(symbol.esi) * symbol_size_;
+        const std::size_t len = std::min(static_cast<std::size_t>(symbol_size_),
+                                         static_cast<std::size_t>(chunk_size_) - offset);
+        std::memcpy(decoded_data_.data() + offset, read_symbol(symbol, scratch).data(), len);
+    }
+    release_buffered();
+    decoded_ = true;
+    return true;
+}
 
+bool ChunkDecoder::solve_buffered() {
+    codec_ = make_fec_decoder(fec_, chunk_size_, symbol_size_);
     if (!codec_) {
-        throw std::runtime_error("codec is null");
+        return false;
+    }
+
+    std::vector<std::byte> scratch(symbol_size_);
+    for (const auto &symbol: buffered_) {
+        if (feed_codec(symbol.esi, read_symbol(symbol, scratch))) {
+            break;
+        }
+    }
+    release_buffered();
+    return decoded_;
+}
+
+bool ChunkDecoder::feed_codec(const uint32_t esi, const std::span<const std::byte> payload) {
+    if (!codec_->add_symbol(esi, payload)) {
+        return false;
+    }
+
+    decoded_data_.resize(chunk_size_);
+    codec_->recover(decoded_data_);
+    decoded_ = true;
+    if (!retain_codec_) {
+        codec_.reset();
+    }
+    return true;
+}
+
+bool ChunkDecoder::add_packet(const uint32_t esi, std::span<const std::byte> payload) {
+    if (decoded_) {
+        return true;
     }
 
     ++packets_received_;
 
-    const auto *payloadData = reinterpret_cast<const uint8_t *>(payload.data());
-    const auto payloadSize = static_cast<uint32_t>(payload.size());
-
-    WirehairResult result = wirehair_decode(
-        static_cast<WirehairCodec>(codec_),
-        esi,
-        payloadData,
-        payloadSize
-    );
-
-    if (result == Wirehair_Success) {
-        decoded_data_.resize(chunk_size_);
-        result = wirehair_recover(
-            static_cast<WirehairCodec>(codec_),
-            decoded_data_.data(),
-            chunk_size_
-        );
-
-        if (result != Wirehair_Success) {
-            throw std::runtime_error("wirehair_recover failed");
+    if (esi >= symbol_present_.size()) {
+        if (esi >= static_cast<std::size_t>(k_) * MAX_ESI_PER_SOURCE) {
+            return false;
         }
+        symbol_present_.resize(std::max<std::size_t>(esi + 1, symbol_present_.size() * 2), 0);
+    }
+    if (symbol_present_[esi]) {
+        return false;
+    }
+    symbol_present_[esi] = 1;
+    if (esi < k_) {
+        ++source_received_;
+    }
 
-        decoded_ = true;
-        return true;
+    if (codec_) {
+        // Payloads are views of just the checksummed bytes; a short final symbol is zero padded
+        // here, while the arena pads on store.
+        std::vector<std::byte> padded;
+        if (payload.size() < symbol_size_) {
+            padded.assign(symbol_size_, std::byte{0});
+            std::memcpy(padded.data(), payload.data(), payload.size());
+            payload = padded;
+        }
+        return feed_codec(esi, payload);
     }
-    if (result == Wirehair_NeedMore) {
+
+    // Symbols wait in the shared arena until N have arrived. A complete source set is a plain
+    // copy; anything else builds the FEC decoder once and feeds it the whole backlog.
+    buffered_.push_back({esi, arena_->store(payload), false});
+    ++resident_symbols_;
+    if (buffered_.size() < k_) {
         return false;
     }
-    throw std::runtime_error("wirehair_decode failed with error");
+    return source_received_ == k_ ? assemble_from_sources() : solve_buffered();
 }
 
 std::vector<std::byte> ChunkDecoder::get_decoded_data() const {
@@ -158,90 +244,259 @@ std::vector<std::byte> ChunkDecoder::consume_decoded_data() {
     return std::move(decoded_data_);
 }
 
-Decoder::Decoder() = default;
+std::unique_ptr<FecEncoder> ChunkDecoder::take_encoder() {
+    if (!decoded_) {
+        throw std::runtime_error("data not yet decoded");
+    }
+    if (!codec_) {
+        return nullptr;
+    }
 
-std::optional<DecodedPacket> Decoder::parse_packet(const std::span<const std::byte> packet_data) {
+    auto encoder = codec_->into_encoder();
+    codec_.reset();
+    return encoder;
+}
+
+Decoder::Decoder(const std::size_t memory_budget, const uint32_t shards)
+    : memory_budget_(memory_budget / std::max<uint32_t>(1, shards))
+      , shards_(std::max<uint32_t>(1, shards))
+      , chunks_(std::max<uint32_t>(1, shards)) {
+}
+
+uint32_t Decoder::shard_for_packet(const std::span<const std::byte> packet_data) const {
+    if (packet_data.size() < HEADER_SIZE) {
+        return 0;
+    }
+    return chunks_.shard_of(readU32LE(packet_data, CHUNK_INDEX_OFF));
+}
+
+size_t Decoder::total_packets_received() const {
+    size_t total = 0;
+    for (const auto &shard: shards_) {
+        total += shard.total_packets;
+    }
+    return total;
+}
+
+size_t Decoder::packets_skipped_completed() const {
+    size_t total = 0;
+    for (const auto &shard: shards_) {
+        total += shard.skipped_completed;
+    }
+    return total;
+}
+
+size_t Decoder::packets_foreign_file() const {
+    size_t total = 0;
+    for (const auto &shard: shards_) {
+        total += shard.foreign_file;
+    }
+    return total;
+}
+
+size_t Decoder::resident_symbol_bytes() const {
+    size_t total = 0;
+    for (const auto &shard: shards_) {
+        total += shard.arena ? shard.arena->resident_bytes() : 0;
+    }
+    return total;
+}
+
+size_t Decoder::spilled_symbol_bytes() const {
+    size_t total = 0;
+    for (const auto &shard: shards_) {
+        total += shard.arena ? shard.arena->spilled_bytes() : 0;
+    }
+    return total;
+}
+
+static std::size_t header_size_for(const uint8_t version) {
+    return version == VERSION_ID_V2 ? HEADER_SIZE_V2 : HEADER_SIZE;
+}
+
+static std::size_t crc_offset_for(const uint8_t version) {
+    return version == VERSION_ID_V2 ? CRC_OFF_V2 : CRC_OFF;
+}
+
+// Reads the header fields straight out of the packet bytes and checks the framing, but not the CRC.
+static std::optional<PacketHeader> read_header(const std::span<const std::byte> packet_data) {
     if (packet_data.size() < HEADER_SIZE) {
         return std::nullopt;
     }
 
-    const uint8_t version = readByte(packet_data, VERSION_OFF);
-    const size_t header_size = (version == VERSION_ID_V2) ? HEADER_SIZE_V2 : HEADER_SIZE;
-    if (version != VERSION_ID && version != VERSION_ID_V2) {
+    PacketHeader header;
+    auto &[magic, v, flags, file_id, chunk_index, chunk_size, original_size, symbol_size, k, esi, payload_len, crc] =
+            header;
+
+    v = readByte(packet_data, VERSION_OFF);
+    if (v != VERSION_ID && v != VERSION_ID_V2) {
         return std::nullopt;
     }
+    const size_t header_size = header_size_for(v);
     if (packet_data.size() < header_size) {
         return std::nullopt;
     }
 
-    DecodedPacket result;
-    auto &[magic, v, flags, file_id, chunk_index, chunk_size, original_size, symbol_size, k, esi, payload_len, crc] =
-            result.header;
-
     magic = readU32LE(packet_data, MAGIC_OFF);
     if (magic != MAGIC_ID) {
         return std::nullopt;
     }
 
-    v = version;
     flags = readByte(packet_data, FLAGS_OFF);
-
     std::memcpy(file_id.data(), packet_data.data() + FILE_ID_OFF, FILE_ID_SIZE);
     chunk_index = readU32LE(packet_data, CHUNK_INDEX_OFF);
     chunk_size = readU32LE(packet_data, CHUNK_SIZE_OFF);
-    if (version == VERSION_ID_V2) {
-        original_size = readU32LE(packet_data, ORIGINAL_SIZE_OFF);
-    } else {
-        original_size = chunk_size;
-    }
+    original_size = (v == VERSION_ID_V2) ? readU32LE(packet_data, ORIGINAL_SIZE_OFF) : chunk_size;
     symbol_size = readU16LE(packet_data, SYMBOL_SIZE_OFF);
     k = readU32LE(packet_data, K_OFF);
     esi = readU32LE(packet_data, ESI_OFF);
     payload_len = readU16LE(packet_data, PAYLOAD_LEN_OFF);
-    crc = readU32LE(packet_data, (version == VERSION_ID_V2) ? CRC_OFF_V2 : CRC_OFF);
+    crc = readU32LE(packet_data, crc_offset_for(v));
+
+    if (packet_data.size() < header_size + symbol_size || payload_len > symbol_size) {
+        return std::nullopt;
+    }
+    return header;
+}
 
-    if (const size_t expected_total = header_size + symbol_size; packet_data.size() < expected_total) {
+// The encoder checksums only the payload_len bytes it wrote; the rest of the symbol is padding.
+static bool raw_crc_matches(const PacketHeader &header, const std::span<const std::byte> packet_data) {
+    const size_t header_size = header_size_for(header.version);
+    return packet_crc32c(packet_data.subspan(0, header_size), packet_data.subspan(header_size, header.payload_len),
+                         crc_offset_for(header.version), CRC_SIZE) == header.crc;
+}
+
+std::optional<DecodedPacket> Decoder::parse_packet(const std::span<const std::byte> packet_data) {
+    const auto header = read_header(packet_data);
+    if (!header) {
         return std::nullopt;
     }
-    result.payload.resize(symbol_size);
-    std::memcpy(result.payload.data(), packet_data.data() + header_size, symbol_size);
 
+    DecodedPacket result;
+    result.header = *header;
+    result.payload.resize(header->symbol_size);
+    std::memcpy(result.payload.data(), packet_data.data() + header_size_for(header->version), header->payload_len);
     return result;
 }
 
 bool Decoder::validate_raw_packet_crc(const std::span<const std::byte> packet_data) {
-    if (packet_data.size() < HEADER_SIZE) {
+    const auto header = read_header(packet_data);
+    return header && raw_crc_matches(*header, packet_data);
+}
+
+bool Decoder::chase_repair(const std::span<std::byte> packet_data, const std::span<const uint8_t> bit_confidence,
+                           const uint32_t candidate_bits, const uint32_t max_patterns) {
+    if (packet_data.size() < HEADER_SIZE || bit_confidence.size() < packet_data.size() * 8) {
         return false;
     }
-
     const uint8_t version = readByte(packet_data, VERSION_OFF);
-    const size_t header_size = (version == VERSION_ID_V2) ? HEADER_SIZE_V2 : HEADER_SIZE;
-    const size_t crc_offset = (version == VERSION_ID_V2) ? CRC_OFF_V2 : CRC_OFF;
     if (version != VERSION_ID && version != VERSION_ID_V2) {
         return false;
     }
-    if (packet_data.size() < header_size) {
+    const std::size_t header_size = header_size_for(version);
+    const std::size_t crc_offset = crc_offset_for(version);
+    const std::size_t covered = header_size + readU16LE(packet_data, PAYLOAD_LEN_OFF);
+    if (covered > packet_data.size()) {
         return false;
     }
 
-    const uint16_t symbol_size = readU16LE(packet_data, SYMBOL_SIZE_OFF);
-    if (packet_data.size() < header_size + symbol_size) {
-        return false;
+    // Candidates are the least confident payload bits plus the stored CRC. Header fields stay as
+    // read, so a repair that only fits the CRC by collision can corrupt one symbol's payload but
+    // never file it under the wrong chunk or ESI.
+    struct Candidate {
+        uint32_t bit;
+        uint8_t confidence;
+    };
+    std::vector<Candidate> candidates;
+    candidates.reserve((covered - header_size + CRC_SIZE) * 8);
+    const auto add_byte = [&](const std::size_t byte) {
+        for (uint32_t bit = 0; bit < 8; ++bit) {
+            const auto index = static_cast<uint32_t>(byte * 8 + bit);
+            candidates.push_back({index, bit_confidence[index]});
+        }
+    };
+    for (std::size_t byte = crc_offset; byte < crc_offset + CRC_SIZE; ++byte) {
+        add_byte(byte);
+    }
+    for (std::size_t byte = header_size; byte < covered; ++byte) {
+        add_byte(byte);
+    }
+    const std::size_t count = std::min<std::size_t>(candidate_bits, candidates.size());
+    std::ranges::partial_sort(candidates, candidates.begin() + static_cast<std::ptrdiff_t>(count), {},
+                              &Candidate::confidence);
+    candidates.resize(count);
+
+    // Bits are numbered MSB first within each byte, the order the extractor packs them in.
+    const auto mask_of = [](const uint32_t bit) { return static_cast<uint8_t>(0x80u >> (bit % 8)); };
+    std::vector<uint32_t> deltas(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::size_t byte = candidates[i].bit / 8;
+        const uint8_t mask = mask_of(candidates[i].bit);
+        if (byte >= crc_offset && byte < crc_offset + CRC_SIZE) {
+            // Flipping a stored CRC bit moves the target instead of the checksum.
+            deltas[i] = static_cast<uint32_t>(mask) << (8 * (byte - crc_offset));
+        } else {
+            deltas[i] = crc32c_flip_delta(covered - byte, mask);
+        }
     }
 
-    const uint32_t stored_crc = readU32LE(packet_data, crc_offset);
-
-    const auto header_span = packet_data.subspan(0, header_size);
-    const auto payload_span = packet_data.subspan(header_size, symbol_size);
-    const uint32_t computed_crc = packet_crc32c(header_span, payload_span, crc_offset, CRC_SIZE);
+    const uint32_t syndrome = packet_crc32c(packet_data.subspan(0, header_size),
+                                            packet_data.subspan(header_size, covered - header_size),
+                                            crc_offset, CRC_SIZE) ^ readU32LE(packet_data, crc_offset);
+    if (syndrome == 0) {
+        return validate_raw_packet_crc(packet_data);
+    }
+
+    // Try flip patterns in order of weight, since few errors are far more likely than many. Every
+    // pattern within the budget is checked, and the repair is only made when exactly one of them
+    // matches; two matches mean at least one is a CRC collision and there is no telling which.
+    uint32_t patterns = 0;
+    std::size_t matches = 0;
+    std::vector<std::size_t> picked;
+    std::vector<std::size_t> match;
+    for (std::size_t weight = 1; weight <= count && patterns < max_patterns; ++weight) {
+        picked.resize(weight);
+        for (std::size_t i = 0; i < weight; ++i) {
+            picked[i] = i;
+        }
+        while (patterns++ < max_patterns) {
+            uint32_t delta = 0;
+            for (const std::size_t i: picked) {
+                delta ^= deltas[i];
+            }
+            if (delta == syndrome && ++matches == 1) {
+                match = picked;
+            }
+            if (matches > 1) {
+                return false;
+            }
 
-    return stored_crc == computed_crc;
+            std::size_t pos = weight;
+            while (pos > 0 && picked[pos - 1] == count - weight + pos - 1) {
+                --pos;
+            }
+            if (pos == 0) {
+                break;
+            }
+            ++picked[pos - 1];
+            for (std::size_t i = pos; i < weight; ++i) {
+                picked[i] = picked[i - 1] + 1;
+            }
+        }
+    }
+    if (matches != 1) {
+        return false;
+    }
+    for (const std::size_t i: match) {
+        packet_data[candidates[i].bit / 8] ^= std::byte{mask_of(candidates[i].bit)};
+    }
+    return validate_raw_packet_crc(packet_data);
 }
 
 bool Decoder::validate_packet_crc(const DecodedPacket &packet) {
     const bool is_v2 = (packet.header.version == VERSION_ID_V2);
-    const size_t header_size = is_v2 ? HEADER_SIZE_V2 : HEADER_SIZE;
-    const size_t crc_offset = is_v2 ? CRC_OFF_V2 : CRC_OFF;
+    const size_t header_size = header_size_for(packet.header.version);
+    const size_t crc_offset = crc_offset_for(packet.header.version);
 
     std::array<std::byte, HEADER_SIZE_V2> header{};
     const std::span buf(header.data(), header_size);
@@ -277,171 +532,183 @@ bool Decoder::validate_packet_crc(const DecodedPacket &packet) {
     constexpr uint32_t zero_crc = 0;
     std::memcpy(buf.data() + crc_offset, &zero_crc, sizeof(zero_crc));
     const std::span<const std::byte> headerSpan(header.data(), header_size);
-    const std::span payloadSpan(packet.payload.data(), packet.payload.size());
+    if (packet.header.payload_len > packet.payload.size()) {
+        return false;
+    }
+    const std::span payloadSpan(packet.payload.data(), packet.header.payload_len);
     const uint32_t computed_crc = packet_crc32c(headerSpan, payloadSpan, crc_offset, CRC_SIZE);
 
     return computed_crc == packet.header.crc;
 }
 
-static std::optional<DecodedPacket> parse_and_validate_packet(const std::span<const std::byte> packet_data) {
-    if (packet_data.size() < HEADER_SIZE) {
-        return std::nullopt;
-    }
-
-    DecodedPacket result;
-    auto &[magic, v, flags, file_id, chunk_index, chunk_size, original_size, symbol_size, k, esi, payload_len, crc] =
-            result.header;
+std::optional<ChunkDecodeResult> Decoder::process_packet(const std::span<const std::byte> packet_data) {
+    Shard &shard = shards_[shard_for_packet(packet_data)];
+    ++shard.total_packets;
 
-    v = readByte(packet_data, VERSION_OFF);
-    if (v != VERSION_ID && v != VERSION_ID_V2) {
-        return std::nullopt;
-    }
-    const size_t header_size = (v == VERSION_ID_V2) ? HEADER_SIZE_V2 : HEADER_SIZE;
-    const size_t crc_offset = (v == VERSION_ID_V2) ? CRC_OFF_V2 : CRC_OFF;
-    if (packet_data.size() < header_size) {
+    // Once a chunk is done its remaining packets are dead weight (half the stream on a clean
+    // channel), so drop them on the raw index before any parsing or CRC work.
+    if (packet_data.size() >= HEADER_SIZE && completed_.test(readU32LE(packet_data, CHUNK_INDEX_OFF))) {
+        ++shard.skipped_completed;
         return std::nullopt;
     }
 
-    magic = readU32LE(packet_data, MAGIC_OFF);
-    if (magic != MAGIC_ID) {
+    const auto header = read_header(packet_data);
+    if (!header || !raw_crc_matches(*header, packet_data)) {
         return std::nullopt;
     }
 
-    flags = readByte(packet_data, FLAGS_OFF);
-    std::memcpy(file_id.data(), packet_data.data() + FILE_ID_OFF, FILE_ID_SIZE);
-    chunk_index = readU32LE(packet_data, CHUNK_INDEX_OFF);
-    chunk_size = readU32LE(packet_data, CHUNK_SIZE_OFF);
-    original_size = (v == VERSION_ID_V2) ? readU32LE(packet_data, ORIGINAL_SIZE_OFF) : chunk_size;
-    symbol_size = readU16LE(packet_data, SYMBOL_SIZE_OFF);
-    k = readU32LE(packet_data, K_OFF);
-    esi = readU32LE(packet_data, ESI_OFF);
-    payload_len = readU16LE(packet_data, PAYLOAD_LEN_OFF);
+    return accept_packet(shard, *header, packet_data.subspan(header_size_for(header->version), header->payload_len));
+}
 
-    if (packet_data.size() < header_size + symbol_size) {
+std::optional<ChunkDecodeResult> Decoder::process_packet(const DecodedPacket &packet) {
+    Shard &shard = shards_[chunks_.shard_of(packet.header.chunk_index)];
+    ++shard.total_packets;
+    if (completed_.test(packet.header.chunk_index)) {
+        ++shard.skipped_completed;
         return std::nullopt;
     }
-
-    crc = readU32LE(packet_data, crc_offset);
-    const auto header_span = packet_data.subspan(0, header_size);
-    if (const auto payload_span = packet_data.subspan(header_size, symbol_size); packet_crc32c(header_span,
-            payload_span, crc_offset, CRC_SIZE) != crc) {
+    if (!validate_packet_crc(packet)) {
         return std::nullopt;
     }
 
-    result.payload.resize(symbol_size);
-    std::memcpy(result.payload.data(), packet_data.data() + header_size, symbol_size);
-
-    return result;
+    return accept_packet(shard, packet.header, packet.payload);
 }
 
-std::optional<ChunkDecodeResult> Decoder::process_packet(const std::span<const std::byte> packet_data) {
-    ++total_packets_;
+std::optional<ChunkDecodeResult> Decoder::accept_packet(Shard &shard, const PacketHeader &hdr,
+                                                        const std::span<const std::byte> payload) {
+    if (!id_set_.load(std::memory_order_acquire)) {
+        const std::lock_guard lock(id_mutex_);
+        if (!id) {
+            id = hdr.file_id;
+            encrypted_ = (hdr.flags & Encrypted) != 0;
+            id_set_.store(true, std::memory_order_release);
+        }
+    }
+    if (hdr.file_id != *id) {
+        ++shard.foreign_file;
+        return std::nullopt;
+    }
 
-    const auto parsed = parse_and_validate_packet(packet_data);
-    if (!parsed) {
+    if (hdr.chunk_index >= MAX_CHUNK_COUNT) {
+        return std::nullopt;
+    }
+    if ((hdr.flags & LastChunk) != 0) {
+        expected_chunks_.store(hdr.chunk_index + 1, std::memory_order_release);
+    }
+    if (completed_.test(hdr.chunk_index)) {
         return std::nullopt;
     }
 
-    const PacketHeader &hdr = parsed->header;
-    if (!id) {
-        id = hdr.file_id;
-        encrypted_ = (hdr.flags & Encrypted) != 0;
+    const auto fec = fec_scheme_from_flags(hdr.flags);
+    if (!fec) {
+        return std::nullopt;
     }
 
-    if (completed_chunks.contains(hdr.chunk_index)) {
+    if (!shard.arena) {
+        shard.arena = std::make_unique<SymbolArena>(hdr.symbol_size);
+    } else if (hdr.symbol_size != shard.arena->symbol_bytes()) {
         return std::nullopt;
     }
 
-    auto it = active_decoders.find(hdr.chunk_index);
-    if (it == active_decoders.end()) {
-        auto [inserted_it, success] = active_decoders.emplace(
-            std::piecewise_construct,
-            std::forward_as_tuple(hdr.chunk_index),
-            std::forward_as_tuple(hdr.chunk_index, hdr.chunk_size, hdr.k, hdr.symbol_size)
-        );
-        it = inserted_it;
+    ChunkSlot &slot = chunks_.slot(hdr.chunk_index);
+    if (slot.state == ChunkState::Empty) {
+        slot.codec = std::make_unique<ChunkDecoder>(hdr.chunk_index, hdr.chunk_size, hdr.k, hdr.symbol_size,
+                                                    *shard.arena, *fec);
+        slot.codec->set_retain_codec(heal_mode_);
+        slot.state = ChunkState::Partial;
+    } else if (!slot.codec->has_geometry(hdr.chunk_size, hdr.k, hdr.symbol_size)) {
+        // A packet that passed its CRC yet disagrees with the chunk's first packet is a
+        // collision or a soft repair gone wrong; feeding it would poison the whole chunk.
+        return std::nullopt;
     }
+    ++slot.packets_received;
 
-    ChunkDecoder &decoder = it->second;
-    if (const std::span payloadSpan(parsed->payload.data(), parsed->payload.size()); decoder.add_packet(
-        hdr.esi, payloadSpan)) {
+    ChunkDecoder &decoder = *slot.codec;
+    decoder.mark_used(++shard.tick);
+    if (decoder.add_packet(hdr.esi, payload)) {
         ChunkDecodeResult result;
         result.chunk_index = hdr.chunk_index;
-        result.data = decoder.consume_decoded_data();
-        const uint32_t copy_len = std::min(static_cast<uint32_t>(result.data.size()), hdr.original_size);
-        result.data.resize(copy_len);
-        result.sha256 = sha256(std::span<const std::byte>(result.data.data(), result.data.size()));
+        result.flags = hdr.flags;
+        if (heal_mode_) {
+            result.encoder = decoder.take_encoder();
+        }
+        if (!scan_mode_) {
+            result.data = decoder.consume_decoded_data();
+            const uint32_t copy_len = std::min(static_cast<uint32_t>(result.data.size()), hdr.original_size);
+            result.data.resize(copy_len);
+            result.sha256 = sha256(std::span<const std::byte>(result.data.data(), result.data.size()));
+        }
         result.success = true;
-        completed_chunks[hdr.chunk_index] = std::move(result.data);
-        active_decoders.erase(it);
+        if (!heal_mode_ && !scan_mode_) {
+            slot.data = std::move(result.data);
+        }
+        slot.codec.reset();
+        slot.state = ChunkState::Complete;
+        completed_.set(hdr.chunk_index);
 
         return result;
     }
 
+    enforce_memory_budget(shard, chunks_.shard_of(hdr.chunk_index));
     return std::nullopt;
 }
 
-std::optional<ChunkDecodeResult> Decoder::process_packet(const DecodedPacket &packet) {
-    ++total_packets_;
-    if (!validate_packet_crc(packet)) {
-        return std::nullopt;
+void Decoder::enforce_memory_budget(Shard &shard, const uint32_t shard_index) {
+    if (shard.arena->resident_bytes() <= memory_budget_) {
+        return;
     }
 
-    const PacketHeader &hdr = packet.header;
-    if (!id) {
-        id = hdr.file_id;
-        encrypted_ = (hdr.flags & Encrypted) != 0;
-    }
+    // Spill the least recently touched partial chunks until we are back under 3/4 of the
+    // budget, so a decode hovering at the limit does not rescan the table on every packet.
+    std::vector<std::pair<uint64_t, ChunkDecoder *> > candidates;
+    chunks_.for_each_in_shard(shard_index, [&candidates](uint32_t, const ChunkSlot &slot) {
+        if (slot.state == ChunkState::Partial && slot.codec->resident_symbols() > 0) {
+            candidates.emplace_back(slot.codec->last_used(), slot.codec.get());
+        }
+    });
+    std::ranges::sort(candidates, {}, &std::pair<uint64_t, ChunkDecoder *>::first);
 
-    if (completed_chunks.contains(hdr.chunk_index)) {
-        return std::nullopt;
+    const std::size_t target = memory_budget_ / 4 * 3;
+    for (const auto &decoder: candidates | std::views::values) {
+        if (shard.arena->resident_bytes() <= target) {
+            break;
+        }
+        decoder->spill_symbols();
     }
+}
 
-    auto it = active_decoders.find(hdr.chunk_index);
-    if (it == active_decoders.end()) {
-        auto [inserted_it, success] = active_decoders.emplace(
-            std::piecewise_construct,
-            std::forward_as_tuple(hdr.chunk_index),
-            std::forward_as_tuple(hdr.chunk_index, hdr.chunk_size, hdr.k, hdr.symbol_size)
-        );
-        it = inserted_it;
+bool Decoder::all_chunks_complete() const {
+    const uint32_t expected = expected_chunks();
+    if (expected == 0 || completed_.count() < expected) {
+        return false;
     }
-
-    ChunkDecoder &decoder = it->second;
-    if (const std::span payloadSpan(packet.payload.data(), packet.payload.size()); decoder.add_packet(
-        hdr.esi, payloadSpan)) {
-        ChunkDecodeResult result;
-        result.chunk_index = hdr.chunk_index;
-        result.data = decoder.consume_decoded_data();
-        const uint32_t copy_len = std::min(static_cast<uint32_t>(result.data.size()), hdr.original_size);
-        result.data.resize(copy_len);
-        result.sha256 = sha256(std::span<const std::byte>(result.data.data(), result.data.size()));
-        result.success = true;
-        completed_chunks[hdr.chunk_index] = std::move(result.data);
-        active_decoders.erase(it);
-
-        return result;
+    for (uint32_t index = 0; index < expected; ++index) {
+        if (!completed_.test(index)) {
+            return false;
+        }
     }
-
-    return std::nullopt;
+    return true;
 }
 
 bool Decoder::is_chunk_complete(const uint32_t chunk_index) const {
-    return completed_chunks.contains(chunk_index);
+    return completed_.test(chunk_index);
 }
 
 std::optional<std::vector<std::byte> > Decoder::get_chunk_data(const uint32_t chunk_index) const {
-    if (const auto it = completed_chunks.find(chunk_index); it != completed_chunks.end()) {
-        return it->second;
+    if (const ChunkSlot *slot = chunks_.find(chunk_index); slot && slot->state == ChunkState::Complete) {
+        return slot->data;
     }
     return std::nullopt;
 }
 
 std::vector<uint32_t> Decoder::completed_chunk_indices() const {
     std::vector<uint32_t> indices;
-    indices.reserve(completed_chunks.size());
-    for (const auto &index: completed_chunks | std::views::keys) {
-        indices.push_back(index);
+    indices.reserve(completed_.count());
+    const uint32_t extent = chunks_.extent();
+    for (uint32_t index = 0; index < extent; ++index) {
+        if (completed_.test(index)) {
+            indices.push_back(index);
+        }
     }
     return indices;
 }
@@ -460,15 +727,12 @@ void Decoder::clear_decrypt_key() {
 
 namespace {
     std::optional<std::vector<std::size_t> > compute_chunk_sizes(
-        const std::unordered_map<uint32_t, std::vector<std::byte> > &chunks,
-        const uint32_t expected_chunks,
+        const std::vector<const std::vector<std::byte> *> &chunks,
         const bool encrypted,
         const bool decrypt_key_set) {
-        std::vector<std::size_t> sizes(expected_chunks);
-        for (const auto &[idx, chunk]: chunks) {
-            if (idx >= expected_chunks) {
-                return std::nullopt;
-            }
+        std::vector<std::size_t> sizes(chunks.size());
+        for (std::size_t idx = 0; idx < chunks.size(); ++idx) {
+            const auto &chunk = *chunks[idx];
             if (encrypted && decrypt_key_set) {
                 if (chunk.size() < CRYPTO_PLAIN_SIZE_HEADER) {
                     return std::nullopt;
@@ -495,21 +759,15 @@ namespace {
 
     void decrypt_and_copy_into(
         std::vector<std::byte> &result,
-        const std::unordered_map<uint32_t, std::vector<std::byte> > &chunks,
-        const uint32_t expected_chunks,
+        const std::vector<const std::vector<std::byte> *> &chunk_ptrs,
         const std::vector<std::size_t> &offsets,
         const std::vector<std::size_t> &sizes,
         const bool encrypted,
         const bool decrypt_key_set,
         const std::array<std::byte, 32> &decrypt_key,
         const std::array<std::byte, 16> &file_id) {
-        std::vector<const std::vector<std::byte> *> chunk_ptrs(expected_chunks);
-        for (uint32_t i = 0; i < expected_chunks; ++i) {
-            chunk_ptrs[i] = &chunks.at(i);
-        }
-
 #pragma omp parallel for schedule(static)
-        for (int i = 0; i < static_cast<int>(expected_chunks); ++i) {
+        for (int i = 0; i < static_cast<int>(chunk_ptrs.size()); ++i) {
             const auto &chunk = *chunk_ptrs[i];
             const std::size_t copy_size = sizes[i];
             if (encrypted && decrypt_key_set) {
@@ -524,14 +782,9 @@ namespace {
 }
 
 std::optional<std::vector<std::byte> > Decoder::assemble_file(const uint32_t expected_chunks) const {
-    if (completed_chunks.size() != expected_chunks) {
+    if (completed_.count() != expected_chunks || chunks_.extent() > expected_chunks) {
         return std::nullopt;
     }
-    for (const auto &idx: completed_chunks | std::views::keys) {
-        if (idx >= expected_chunks) {
-            return std::nullopt;
-        }
-    }
     if (encrypted_ && !decrypt_key_set_) {
         return std::nullopt;
     }
@@ -539,14 +792,22 @@ std::optional<std::vector<std::byte> > Decoder::assemble_file(const uint32_t exp
         return std::nullopt;
     }
 
-    const auto chunk_sizes = compute_chunk_sizes(
-        completed_chunks, expected_chunks, encrypted_, decrypt_key_set_);
+    std::vector<const std::vector<std::byte> *> chunk_ptrs(expected_chunks);
+    for (uint32_t i = 0; i < expected_chunks; ++i) {
+        const ChunkSlot *slot = chunks_.find(i);
+        if (!slot || slot->state != ChunkState::Complete) {
+            return std::nullopt;
+        }
+        chunk_ptrs[i] = &slot->data;
+    }
+
+    const auto chunk_sizes = compute_chunk_sizes(chunk_ptrs, encrypted_, decrypt_key_set_);
     if (!chunk_sizes) {
         return std::nullopt;
     }
     const auto offsets = compute_prefix_offsets(*chunk_sizes);
     std::vector<std::byte> result(offsets[expected_chunks]);
-    decrypt_and_copy_into(result, completed_chunks, expected_chunks, offsets,
+    decrypt_and_copy_into(result, chunk_ptrs, offsets,
                           *chunk_sizes, encrypted_, decrypt_key_set_, decrypt_key_, *id);
     return result;
 }
@@ -19,15 +19,21 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <optional>
-#include <unordered_map>
 #include <span>
 #include <vector>
 
+#include "chunk_bitmap.h"
+#include "chunk_table.h"
 #include "integrity.h"
 #include "configuration.h"
+#include "fec.h"
+#include "symbol_arena.h"
 
 struct PacketHeader {
     uint32_t magic = 0;
@@ -54,11 +60,16 @@ struct ChunkDecodeResult {
     std::vector<std::byte> data;
     Sha256Digest sha256{};
     bool success = false;
+    uint8_t flags = 0;
+    // Heal mode only: the chunk's solved FEC decoder, already turned into an encoder.
+    // Empty when the chunk completed from source symbols alone.
+    std::shared_ptr<FecEncoder> encoder;
 };
 
 class ChunkDecoder {
 public:
-    explicit ChunkDecoder(uint32_t chunk_index, uint32_t chunk_size, uint32_t k, uint16_t symbol_size);
+    explicit ChunkDecoder(uint32_t chunk_index, uint32_t chunk_size, uint32_t k, uint16_t symbol_size,
+                          SymbolArena &arena, FecScheme fec = FecScheme::Wirehair);
 
     ~ChunkDecoder();
 
@@ -78,26 +89,76 @@ public:
 
     [[nodiscard]] std::vector<std::byte> consume_decoded_data();
 
+    void set_retain_codec(const bool retain) { retain_codec_ = retain; }
+
+    [[nodiscard]] std::unique_ptr<FecEncoder> take_encoder();
+
     [[nodiscard]] uint32_t chunk_index() const { return chunk_index_; }
 
+    [[nodiscard]] bool has_geometry(const uint32_t chunk_size, const uint32_t k, const uint16_t symbol_size) const {
+        return chunk_size == chunk_size_ && k == k_ && symbol_size == symbol_size_;
+    }
+
     [[nodiscard]] uint32_t packets_received() const { return packets_received_; }
 
+    [[nodiscard]] std::size_t resident_symbols() const { return resident_symbols_; }
+
+    void spill_symbols();
+
+    void mark_used(const uint64_t tick) { last_used_ = tick; }
+
+    [[nodiscard]] uint64_t last_used() const { return last_used_; }
+
 private:
+    struct BufferedSymbol {
+        uint32_t esi = 0;
+        uint32_t slot = 0;
+        bool spilled = false;
+    };
+
     uint32_t chunk_index_;
     uint32_t chunk_size_;
     uint32_t k_;
     uint16_t symbol_size_;
-    void *codec_ = nullptr;
+    SymbolArena *arena_;
+    FecScheme fec_;
+    std::unique_ptr<FecDecoder> codec_;
     bool decoded_ = false;
+    bool retain_codec_ = false;
     uint32_t packets_received_ = 0;
+    uint32_t source_received_ = 0;
+    std::size_t resident_symbols_ = 0;
+    uint64_t last_used_ = 0;
+    std::vector<uint8_t> symbol_present_;
+    std::vector<BufferedSymbol> buffered_;
     std::vector<std::byte> decoded_data_;
+
+    [[nodiscard]] std::span<const std::byte> read_symbol(const BufferedSymbol &symbol,
+                                                         std::span<std::byte> scratch) const;
+
+    [[nodiscard]] bool assemble_from_sources();
+
+    [[nodiscard]] bool solve_buffered();
+
+    [[nodiscard]] bool feed_codec(uint32_t esi, std::span<const std::byte> payload);
+
+    void release_buffered();
 };
 
 class Decoder {
 public:
     using FileId = std::array<std::byte, 16>;
 
-    Decoder();
+    // With more than one shard, process_packet() may be called from several threads at once as
+    // long as each shard (see shard_for_packet) is only ever fed from one thread at a time. The
+    // memory budget is split evenly across shards.
+    explicit Decoder(std::size_t memory_budget = DECODER_MEMORY_BUDGET_BYTES, uint32_t shards = 1);
+
+    [[nodiscard]] uint32_t shard_count() const { return chunks_.shard_count(); }
+
+    [[nodiscard]] uint32_t shard_for_packet(std::span<const std::byte> packet_data) const;
+
+    [[nodiscard]] uint32_t shard_for_chunk(const uint32_t chunk_index) const { return chunks_.shard_of(chunk_index); }
 
     [[nodiscard]] static std::optional<DecodedPacket> parse_packet(std::span<const std::byte> packet_data);
 
@@ -105,6 +166,13 @@ public:
 
     [[nodiscard]] static bool validate_raw_packet_crc(std::span<const std::byte> packet_data);
 
+    // Chase-style soft-decision repair of a packet that fails its CRC: flips combinations of the
+    // `candidate_bits` least confident payload and CRC bits (one confidence byte per packet bit,
+    // MSB first), trying at most `max_patterns` of them. Repairs in place and returns true only
+    // when exactly one pattern matches the CRC.
+    [[nodiscard]] static bool chase_repair(std::span<std::byte> packet_data, std::span<const uint8_t> bit_confidence,
+                                           uint32_t candidate_bits, uint32_t max_patterns);
+
     [[nodiscard]] std::optional<ChunkDecodeResult> process_packet(std::span<const std::byte> packet_data);
 
     [[nodiscard]] std::optional<ChunkDecodeResult> process_packet(const DecodedPacket &packet);
@@ -115,9 +183,28 @@ public:
 
     [[nodiscard]] std::optional<FileId> file_id() const { return id; }
 
-    [[nodiscard]] size_t total_packets_received() const { return total_packets_; }
+    [[nodiscard]] size_t total_packets_received() const;
+
+    [[nodiscard]] size_t chunks_completed() const { return completed_.count(); }
+
+    // Total chunk count, learned from a valid LastChunk packet or given by the caller (for
+    // example from a manifest); 0 while unknown.
+    [[nodiscard]] uint32_t expected_chunks() const { return expected_chunks_.load(std::memory_order_acquire); }
+
+    void set_expected_chunks(const uint32_t count) { expected_chunks_.store(count, std::memory_order_release); }
 
-    [[nodiscard]] size_t chunks_completed() const { return completed_chunks.size(); }
+    // True once the chunk count is known and every one of those chunks is complete.
+    [[nodiscard]] bool all_chunks_complete() const;
+
+    // Packets dropped on their raw chunk_index because that chunk was already complete.
+    [[nodiscard]] size_t packets_skipped_completed() const;
+
+    // Packets dropped because their file id differs from the first valid packet's.
+    [[nodiscard]] size_t packets_foreign_file() const;
+
+    [[nodiscard]] size_t resident_symbol_bytes() const;
+
+    [[nodiscard]] size_t spilled_symbol_bytes() const;
 
     [[nodiscard]] std::vector<uint32_t> completed_chunk_indices() const;
 
@@ -127,14 +214,42 @@ public:
 
     void clear_decrypt_key();
 
+    // Completed chunks are handed to the caller instead of being kept for assemble_file(), and
+    // chunks that needed the solver come back with their codec converted into an encoder.
+    void set_heal_mode(const bool heal) { heal_mode_ = heal; }
+
+    // Chunks are still solved, so completion stays exact, but their data is dropped unhashed
+    // instead of being kept for assemble_file() or handed to the caller.
+    void set_scan_mode(const bool scan) { scan_mode_ = scan; }
+
     [[nodiscard]] bool is_encrypted() const { return encrypted_; }
 
 private:
+    // Everything a shard mutates per packet, kept on its own cache line.
+    struct alignas(64) Shard {
+        std::unique_ptr<SymbolArena> arena;
+        size_t total_packets = 0;
+        size_t skipped_completed = 0;
+        size_t foreign_file = 0;
+        uint64_t tick = 0;
+    };
+
     std::optional<FileId> id;
+    std::atomic<bool> id_set_{false};
+    std::mutex id_mutex_;
     bool encrypted_ = false;
     std::array<std::byte, 32> decrypt_key_{};
     bool decrypt_key_set_ = false;
-    std::unordered_map<uint32_t, ChunkDecoder> active_decoders;
-    std::unordered_map<uint32_t, std::vector<std::byte>> completed_chunks;
-    size_t total_packets_ = 0;
+    bool heal_mode_ = false;
+    bool scan_mode_ = false;
+    std::size_t memory_budget_;
+    std::vector<Shard> shards_;
+    ChunkTable chunks_;
+    ChunkBitmap completed_;
+    std::atomic<uint32_t> expected_chunks_{0};
+
+    [[nodiscard]] std::optional<ChunkDecodeResult> accept_packet(Shard &shard, const PacketHeader &hdr,
+                                                                 std::span<const std::byte> payload);
+
+    void enforce_memory_budget(Shard &shard, uint32_t shard_index);
 };
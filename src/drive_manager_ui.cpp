@@ -16,6 +16,7 @@
 
 #include "drive_manager_ui.h"
 #include "chunker.h"
+#include "codec_profile.h"
 #include "configuration.h"
 #include "crypto.h"
 #include "encoder.h"
@@ -38,9 +39,9 @@
 #include <fstream>
 
 WorkerThread::WorkerThread(Operation op, const QString& input, const QString& output,
-                         bool encrypt, const QString& password, QObject* parent)
+                         bool encrypt, const QString& password, const QString& codecProfile, QObject* parent)
     : QThread(parent), operation(op), inputPath(input), outputPath(output),
-      encrypt(encrypt), password(password) {
+      encrypt(encrypt), password(password), codecProfile(codecProfile) {
 }
 
 void WorkerThread::run() {
@@ -114,7 +115,12 @@ void WorkerThread::run() {
             emit progressUpdated(90);
             emit statusUpdated("Creating video file...");
             
-            VideoEncoder video_encoder(outputPath.toStdString());
+            VideoEncoderOptions video_options;
+            if (!codecProfile.isEmpty()) {
+                video_options.profile = codecProfile.toStdString();
+            }
+            emit logMessage("Codec profile: " + QString::fromStdString(video_options.profile));
+            VideoEncoder video_encoder(outputPath.toStdString(), video_options);
             for (auto& packets : all_chunk_packets) {
                 video_encoder.encode_packets(packets);
                 packets.clear();
@@ -156,10 +162,10 @@ void WorkerThread::run() {
             emit statusUpdated("Extracting packets from video...");
             std::size_t valid_frames = 0;
             
-            while (!video_decoder.is_eof()) {
-                if (auto frame_packets = video_decoder.decode_next_frame(); !frame_packets.empty()) {
+            while (!video_decoder.is_eof() && !decoder.all_chunks_complete()) {
+                if (const auto &frame_packets = video_decoder.decode_next_frame(); !frame_packets.empty()) {
                     ++valid_frames;
-                    for (auto& pkt_data : frame_packets) {
+                    for (const auto& pkt_data : frame_packets) {
                         ++total_extracted;
                         
                         if (pkt_data.size() >= HEADER_SIZE) {
@@ -174,8 +180,7 @@ void WorkerThread::run() {
                             }
                         }
                         
-                        const std::span<const std::byte> data(pkt_data.data(), pkt_data.size());
-                        if (auto result = decoder.process_packet(data); result && result->success) {
+                        if (auto result = decoder.process_packet(pkt_data); result && result->success) {
                             ++decoded_chunks;
                         }
                     }
@@ -189,6 +194,7 @@ void WorkerThread::run() {
             
             emit logMessage(QString("Valid frames: %1").arg(valid_frames));
             emit logMessage(QString("Packets extracted: %1").arg(total_extracted));
+            emit logMessage(QString("Packets skipped (chunk complete): %1").arg(decoder.packets_skipped_completed()));
             
             if (total_extracted == 0) {
                 emit operationCompleted(false, "No packets could be extracted from the video");
@@ -263,8 +269,8 @@ DriveManagerUI::DriveManagerUI(QWidget* parent)
     setWindowTitle("YouTube Media Storage - Drive Manager");
     setMinimumSize(1200, 800);
     
-    loadSettings();
     setupUI();
+    loadSettings();
     setupMenuBar();
     setupStatusBar();
     connectSignals();
@@ -323,13 +329,20 @@ void DriveManagerUI::setupUI() {
     passwordVisibilityButton->setFixedWidth(selectInputButton->sizeHint().width());
     fileOpsLayout->addWidget(passwordVisibilityButton, 3, 2);
     
+    fileOpsLayout->addWidget(new QLabel("Codec:"), 4, 0);
+    codecCombo = new QComboBox();
+    for (const auto& profile : codec_profiles()) {
+        codecCombo->addItem(QString::fromUtf8(profile.description), QString::fromUtf8(profile.name));
+    }
+    fileOpsLayout->addWidget(codecCombo, 4, 1, 1, 2);
+    
     encodeButton = new QPushButton("Encode to Video");
     encodeButton->setIcon(QIcon::fromTheme("media-record"));
-    fileOpsLayout->addWidget(encodeButton, 4, 0, 1, 3);
+    fileOpsLayout->addWidget(encodeButton, 5, 0, 1, 3);
     
     decodeButton = new QPushButton("Decode from Video");
     decodeButton->setIcon(QIcon::fromTheme("media-playback-start"));
-    fileOpsLayout->addWidget(decodeButton, 5, 0, 1, 3);
+    fileOpsLayout->addWidget(decodeButton, 6, 0, 1, 3);
     
     leftLayout->addWidget(fileOperationsGroup);
     
@@ -524,7 +537,8 @@ void DriveManagerUI::startEncode() {
     decodeButton->setEnabled(false);
     
     workerThread = std::make_unique<WorkerThread>(WorkerThread::Encode, 
-        inputFileEdit->text(), outputFileEdit->text(), encrypt, passwordEdit->text(), this);
+        inputFileEdit->text(), outputFileEdit->text(), encrypt, passwordEdit->text(),
+        codecCombo->currentData().toString(), this);
     
     connect(workerThread.get(), &WorkerThread::progressUpdated, 
         this, &DriveManagerUI::onProgressUpdated);
@@ -554,7 +568,7 @@ void DriveManagerUI::startDecode() {
     decodeButton->setEnabled(false);
     
     workerThread = std::make_unique<WorkerThread>(WorkerThread::Decode, 
-        inputFileEdit->text(), outputFileEdit->text(), false, passwordEdit->text(), this);
+        inputFileEdit->text(), outputFileEdit->text(), false, passwordEdit->text(), QString(), this);
     
     connect(workerThread.get(), &WorkerThread::progressUpdated, 
         this, &DriveManagerUI::onProgressUpdated);
@@ -688,10 +702,15 @@ void DriveManagerUI::loadSettings() {
     QSettings settings;
     restoreGeometry(settings.value("geometry").toByteArray());
     restoreState(settings.value("windowState").toByteArray());
+    const int codecIndex = codecCombo->findData(settings.value("codecProfile").toString());
+    if (codecIndex >= 0) {
+        codecCombo->setCurrentIndex(codecIndex);
+    }
 }
 
 void DriveManagerUI::saveSettings() {
     QSettings settings;
     settings.setValue("geometry", saveGeometry());
     settings.setValue("windowState", saveState());
+    settings.setValue("codecProfile", codecCombo->currentData());
 }
@@ -52,7 +52,8 @@ public:
     };
 
     WorkerThread(Operation op, const QString& input, const QString& output,
-                 bool encrypt = false, const QString& password = QString(), QObject* parent = nullptr);
+                 bool encrypt = false, const QString& password = QString(),
+                 const QString& codecProfile = QString(), QObject* parent = nullptr);
 
 signals:
     void progressUpdated(int percentage);
@@ -69,6 +70,7 @@ private:
     QString outputPath;
     bool encrypt;
     QString password;
+    QString codecProfile;
 };
 
 class DriveManagerUI : public QMainWindow {
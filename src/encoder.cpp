@@ -17,24 +17,11 @@
 #include "encoder.h"
 
 #include "configuration.h"
-#include "libs/wirehair/wirehair.h"
 
 #include <algorithm>
-#include <cmath>
 #include <cstring>
-#include <mutex>
 #include <stdexcept>
 
-static std::once_flag ensure_init;
-
-static void ensureWirehairInit() {
-    std::call_once(ensure_init, [] {
-        if (const WirehairResult result = wirehair_init(); result != Wirehair_Success) {
-            throw std::runtime_error("wirehair_init failed");
-        }
-    });
-}
-
 static void writeByte(std::span<std::byte> buffer, const std::size_t offset, const uint8_t value) {
     buffer[offset] = std::byte{value};
 }
@@ -54,15 +41,10 @@ static uint32_t computeNumSourceSymbols(const std::size_t dataSize, const std::s
     return static_cast<uint32_t>(count);
 }
 
-static uint32_t computeRepairCount(const uint32_t numSource, const double overhead) {
-    const double repairDouble = static_cast<double>(numSource) * overhead;
-    return static_cast<uint32_t>(std::ceil(repairDouble));
-}
-
 static uint8_t buildFlags(const uint32_t blockId, const uint32_t numSource, const bool isLastChunk,
-                          const bool encrypted) {
-    uint8_t flags = None;
-    if (blockId > numSource) {
+                          const bool encrypted, const FecScheme fec) {
+    uint8_t flags = fec_scheme_flags(fec);
+    if (blockId >= numSource) {
         flags |= IsRepairSymbol;
     }
     if (isLastChunk) {
@@ -75,8 +57,9 @@ static uint8_t buildFlags(const uint32_t blockId, const uint32_t numSource, cons
 }
 
 
-Encoder::Encoder(const FileId file_id)
-    : id(file_id) {
+Encoder::Encoder(const FileId file_id, const FecScheme fec)
+    : id(file_id)
+      , fec_(fec) {
 }
 
 void Encoder::write_packet_header(
@@ -114,9 +97,8 @@ Encoder::encode_chunk(
     const uint32_t chunk_index,
     const std::span<const std::byte> chunk_data,
     const bool is_last_chunk,
-    const bool encrypted) const {
-    ensureWirehairInit();
-
+    const bool encrypted,
+    FecEncoder *prepared_fec) const {
     if (chunk_data.size() > CHUNK_SIZE_BYTES) {
         throw std::runtime_error("chunkData larger than CHUNK_SIZE_BYTES");
     }
@@ -143,19 +125,21 @@ Encoder::encode_chunk(
     manifest.N = numSource;
     manifest.sha256 = sha256(chunk_data);
 
-    const auto* msgData = reinterpret_cast<const uint8_t*>(data_to_encode.data());
-    const auto msgSize = static_cast<uint32_t>(data_to_encode.size());
-    constexpr auto symbolSizeU32 = static_cast<uint32_t>(SYMBOL_SIZE_BYTES);
-    const WirehairCodec codec = wirehair_encoder_create(nullptr, msgData, msgSize, symbolSizeU32);
-    if (!codec) {
-        throw std::runtime_error("wirehair_encoder_create() failed");
+    const uint32_t repairCount = fec_repair_count(fec_, numSource);
+    std::unique_ptr<FecEncoder> owned_fec;
+    FecEncoder *fec = prepared_fec;
+    if (!fec && repairCount > 0) {
+        owned_fec = make_fec_encoder(fec_, data_to_encode, symbolSize);
+        fec = owned_fec.get();
     }
 
-    const uint32_t repairCount = computeRepairCount(numSource, REPAIR_OVERHEAD);
-    constexpr uint32_t firstBlockId = INCLUDE_SOURCE ? 1u : (numSource + 1u);
-    const uint32_t lastBlockId = numSource + repairCount;
+    // Block ids 0..N-1 are the original symbols; a decoder that receives all of them never solves.
+    // Only Wirehair can rebuild a chunk from repair symbols alone.
+    const bool sendSource = INCLUDE_SOURCE || fec_ != FecScheme::Wirehair;
+    const uint32_t firstBlockId = sendSource ? 0u : numSource;
+    const uint32_t lastBlockId = numSource + repairCount - 1u;
 
-    const uint32_t sourceCount = INCLUDE_SOURCE ? numSource : 0u;
+    const uint32_t sourceCount = sendSource ? numSource : 0u;
     const uint32_t packetCount = sourceCount + repairCount;
 
     std::vector<Packet> packets;
@@ -165,16 +149,22 @@ Encoder::encode_chunk(
         Packet packet;
         packet.bytes.resize(HEADER_SIZE_V2 + SYMBOL_SIZE_BYTES);
 
-        auto *payload_dest = reinterpret_cast<uint8_t *>(packet.bytes.data() + HEADER_SIZE_V2);
+        std::byte *payload_dest = packet.bytes.data() + HEADER_SIZE_V2;
         uint32_t writeLen = 0;
-        if (const WirehairResult result = wirehair_encode(codec, blockId, payload_dest, static_cast<uint32_t>(SYMBOL_SIZE_BYTES), &writeLen); result != Wirehair_Success) {
-            wirehair_free(codec);
-            throw std::runtime_error("wirehair_encode() failed");
+        if (blockId < numSource) {
+            const std::size_t offset = static_cast<std::size_t>(blockId) * SYMBOL_SIZE_BYTES;
+            writeLen = static_cast<uint32_t>(std::min(SYMBOL_SIZE_BYTES, data_to_encode.size() - offset));
+            std::memcpy(payload_dest, data_to_encode.data() + offset, writeLen);
+        } else {
+            writeLen = fec->encode_repair(blockId, std::span(payload_dest, SYMBOL_SIZE_BYTES));
+            if (writeLen == 0) {
+                throw std::runtime_error("FEC repair symbol encode failed");
+            }
         }
 
-        const uint8_t flags = buildFlags(blockId, numSource, is_last_chunk, encrypted);
+        const uint8_t flags = buildFlags(blockId, numSource, is_last_chunk, encrypted, fec_);
         const auto payloadLen = static_cast<uint16_t>(writeLen);
-        const std::span<const std::byte> payload_span(packet.bytes.data() + HEADER_SIZE_V2, writeLen);
+        const std::span<const std::byte> payload_span(payload_dest, writeLen);
 
         write_packet_header(
             std::span(packet.bytes.data(), HEADER_SIZE_V2),
@@ -183,7 +173,5 @@ Encoder::encode_chunk(
         packets.push_back(std::move(packet));
     }
 
-    wirehair_free(codec);
-
     return {std::move(packets), manifest};
 }
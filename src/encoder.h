@@ -25,6 +25,7 @@
 #include <utility>
 #include <vector>
 
+#include "fec.h"
 #include "integrity.h"
 
 struct Packet {
@@ -44,16 +45,21 @@ class Encoder {
 public:
     using FileId = std::array<std::byte, 16>;
 
-    explicit Encoder(FileId file_id);
+    explicit Encoder(FileId file_id, FecScheme fec = FecScheme::Wirehair);
 
+    // prepared_fec may be an encoder already built over this chunk (e.g. a decoder turned
+    // encoder while healing); it is borrowed, not freed.
     [[nodiscard]] std::pair<std::vector<Packet>, ChunkManifestEntry>
     encode_chunk(uint32_t chunk_index, std::span<const std::byte> chunk_data, bool is_last_chunk,
-                bool encrypted = false) const;
+                bool encrypted = false, FecEncoder *prepared_fec = nullptr) const;
 
     [[nodiscard]] const FileId &file_id() const { return id; }
 
+    [[nodiscard]] FecScheme fec_scheme() const { return fec_; }
+
 private:
     FileId id;
+    FecScheme fec_;
 
     void write_packet_header(
         std::span<std::byte> dest,
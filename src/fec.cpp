@@ -0,0 +1,317 @@
+// This file is part of yt-media-storage, a tool for encoding media.
+// Copyright (C) Brandon Li <https://brandonli.me/>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "fec.h"
+
+#include "configuration.h"
+#include "libs/wirehair/wirehair.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+static std::once_flag ensure_init;
+
+static void ensureWirehairInit() {
+    std::call_once(ensure_init, [] {
+        if (const WirehairResult result = wirehair_init(); result != Wirehair_Success) {
+            throw std::runtime_error("wirehair_init failed");
+        }
+    });
+}
+
+static void xor_into(std::byte *dest, const std::byte *src, const std::size_t len) {
+    std::size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t a;
+        uint64_t b;
+        std::memcpy(&a, dest + i, sizeof(a));
+        std::memcpy(&b, src + i, sizeof(b));
+        a ^= b;
+        std::memcpy(dest + i, &a, sizeof(a));
+    }
+    for (; i < len; ++i) {
+        dest[i] ^= src[i];
+    }
+}
+
+std::optional<FecScheme> fec_scheme_from_flags(const uint8_t flags) {
+    switch ((flags & FecSchemeMask) >> FEC_SCHEME_SHIFT) {
+        case 0: return FecScheme::Wirehair;
+        case 1: return FecScheme::None;
+        case 2: return FecScheme::Parity;
+        default: return std::nullopt;
+    }
+}
+
+uint8_t fec_scheme_flags(const FecScheme scheme) {
+    return static_cast<uint8_t>(static_cast<uint8_t>(scheme) << FEC_SCHEME_SHIFT) & FecSchemeMask;
+}
+
+std::optional<FecScheme> parse_fec_scheme(const std::string_view name) {
+    if (name == "wirehair") return FecScheme::Wirehair;
+    if (name == "none") return FecScheme::None;
+    if (name == "parity") return FecScheme::Parity;
+    return std::nullopt;
+}
+
+const char *fec_scheme_name(const FecScheme scheme) {
+    switch (scheme) {
+        case FecScheme::Wirehair: return "wirehair";
+        case FecScheme::None: return "none";
+        case FecScheme::Parity: return "parity";
+    }
+    return "unknown";
+}
+
+uint32_t fec_repair_count(const FecScheme scheme, const uint32_t num_source) {
+    switch (scheme) {
+        case FecScheme::Wirehair:
+            return static_cast<uint32_t>(std::ceil(static_cast<double>(num_source) * REPAIR_OVERHEAD));
+        case FecScheme::None:
+            return 0;
+        case FecScheme::Parity:
+            return (num_source + PARITY_GROUP_SIZE - 1) / PARITY_GROUP_SIZE;
+    }
+    return 0;
+}
+
+namespace {
+    class WirehairFecEncoder final : public FecEncoder {
+    public:
+        explicit WirehairFecEncoder(const WirehairCodec codec) : codec_(codec) {
+        }
+
+        ~WirehairFecEncoder() override {
+            wirehair_free(codec_);
+        }
+
+        WirehairFecEncoder(const WirehairFecEncoder &) = delete;
+
+        WirehairFecEncoder &operator=(const WirehairFecEncoder &) = delete;
+
+        uint32_t encode_repair(const uint32_t esi, const std::span<std::byte> out) override {
+            uint32_t written = 0;
+            if (wirehair_encode(codec_, esi, out.data(), static_cast<uint32_t>(out.size()), &written) !=
+                Wirehair_Success) {
+                return 0;
+            }
+            return written;
+        }
+
+    private:
+        WirehairCodec codec_;
+    };
+
+    class WirehairFecDecoder final : public FecDecoder {
+    public:
+        WirehairFecDecoder(const uint32_t chunk_size, const uint16_t symbol_size) {
+            ensureWirehairInit();
+            codec_ = wirehair_decoder_create(nullptr, chunk_size, symbol_size);
+            if (!codec_) {
+                throw std::runtime_error("wirehair_decoder_create failed");
+            }
+        }
+
+        ~WirehairFecDecoder() override {
+            if (codec_) {
+                wirehair_free(codec_);
+            }
+        }
+
+        WirehairFecDecoder(const WirehairFecDecoder &) = delete;
+
+        WirehairFecDecoder &operator=(const WirehairFecDecoder &) = delete;
+
+        bool add_symbol(const uint32_t esi, const std::span<const std::byte> payload) override {
+            const WirehairResult result = wirehair_decode(codec_, esi, payload.data(),
+                                                          static_cast<uint32_t>(payload.size()));
+            if (result == Wirehair_Success) {
+                return true;
+            }
+            if (result == Wirehair_NeedMore) {
+                return false;
+            }
+            throw std::runtime_error("wirehair_decode failed with error");
+        }
+
+        void recover(const std::span<std::byte> out) override {
+            if (wirehair_recover(codec_, out.data(), out.size()) != Wirehair_Success) {
+                throw std::runtime_error("wirehair_recover failed");
+            }
+        }
+
+        std::unique_ptr<FecEncoder> into_encoder() override {
+            if (wirehair_decoder_becomes_encoder(codec_) != Wirehair_Success) {
+                throw std::runtime_error("wirehair_decoder_becomes_encoder failed");
+            }
+            auto encoder = std::make_unique<WirehairFecEncoder>(codec_);
+            codec_ = nullptr;
+            return encoder;
+        }
+
+    private:
+        WirehairCodec codec_ = nullptr;
+    };
+
+    // One XOR parity symbol per PARITY_GROUP_SIZE sources. Groups are interleaved (source i
+    // belongs to group i % num_parity_), so any burst of up to num_parity_ consecutive lost
+    // sources is repairable.
+    class ParityFecEncoder final : public FecEncoder {
+    public:
+        ParityFecEncoder(const std::span<const std::byte> chunk, const uint16_t symbol_size)
+            : symbol_size_(symbol_size)
+              , num_source_(static_cast<uint32_t>((chunk.size() + symbol_size - 1) / symbol_size))
+              , num_parity_(fec_repair_count(FecScheme::Parity, num_source_))
+              , parity_(static_cast<std::size_t>(num_parity_) * symbol_size_) {
+            for (uint32_t i = 0; i < num_source_; ++i) {
+                const std::size_t offset = static_cast<std::size_t>(i) * symbol_size_;
+                const std::size_t len = std::min<std::size_t>(symbol_size_, chunk.size() - offset);
+                xor_into(parity_.data() + static_cast<std::size_t>(i % num_parity_) * symbol_size_,
+                         chunk.data() + offset, len);
+            }
+        }
+
+        uint32_t encode_repair(const uint32_t esi, const std::span<std::byte> out) override {
+            if (esi < num_source_ || esi - num_source_ >= num_parity_ || out.size() < symbol_size_) {
+                return 0;
+            }
+            std::memcpy(out.data(), parity_.data() + static_cast<std::size_t>(esi - num_source_) * symbol_size_,
+                        symbol_size_);
+            return symbol_size_;
+        }
+
+    private:
+        uint16_t symbol_size_;
+        uint32_t num_source_;
+        uint32_t num_parity_;
+        std::vector<std::byte> parity_;
+    };
+
+    class ParityFecDecoder final : public FecDecoder {
+    public:
+        ParityFecDecoder(const uint32_t chunk_size, const uint16_t symbol_size)
+            : symbol_size_(symbol_size)
+              , num_source_((chunk_size + symbol_size - 1) / symbol_size)
+              , num_parity_(fec_repair_count(FecScheme::Parity, num_source_))
+              , missing_total_(num_source_)
+              , symbols_(static_cast<std::size_t>(num_source_) * symbol_size_)
+              , source_present_(num_source_, 0)
+              , parity_(static_cast<std::size_t>(num_parity_) * symbol_size_)
+              , parity_present_(num_parity_, 0)
+              , missing_in_group_(num_parity_, 0) {
+            for (uint32_t i = 0; i < num_source_; ++i) {
+                ++missing_in_group_[i % num_parity_];
+            }
+        }
+
+        bool add_symbol(const uint32_t esi, const std::span<const std::byte> payload) override {
+            const std::size_t len = std::min<std::size_t>(symbol_size_, payload.size());
+            if (esi < num_source_) {
+                if (!source_present_[esi]) {
+                    std::memcpy(symbols_.data() + static_cast<std::size_t>(esi) * symbol_size_, payload.data(), len);
+                    source_present_[esi] = 1;
+                    --missing_in_group_[esi % num_parity_];
+                    --missing_total_;
+                }
+            } else if (const uint32_t group = esi - num_source_; group < num_parity_ && !parity_present_[group]) {
+                std::memcpy(parity_.data() + static_cast<std::size_t>(group) * symbol_size_, payload.data(), len);
+                parity_present_[group] = 1;
+            }
+            return is_recoverable();
+        }
+
+        void recover(const std::span<std::byte> out) override {
+            for (uint32_t group = 0; group < num_parity_; ++group) {
+                if (missing_in_group_[group] == 0) {
+                    continue;
+                }
+                uint32_t missing = group;
+                std::byte *parity = parity_.data() + static_cast<std::size_t>(group) * symbol_size_;
+                for (uint32_t i = group; i < num_source_; i += num_parity_) {
+                    if (source_present_[i]) {
+                        xor_into(parity, symbols_.data() + static_cast<std::size_t>(i) * symbol_size_, symbol_size_);
+                    } else {
+                        missing = i;
+                    }
+                }
+                std::memcpy(symbols_.data() + static_cast<std::size_t>(missing) * symbol_size_, parity, symbol_size_);
+                source_present_[missing] = 1;
+                missing_in_group_[group] = 0;
+            }
+            missing_total_ = 0;
+            std::memcpy(out.data(), symbols_.data(), std::min(out.size(), symbols_.size()));
+        }
+
+    private:
+        uint16_t symbol_size_;
+        uint32_t num_source_;
+        uint32_t num_parity_;
+        uint32_t missing_total_;
+        std::vector<std::byte> symbols_;
+        std::vector<uint8_t> source_present_;
+        std::vector<std::byte> parity_;
+        std::vector<uint8_t> parity_present_;
+        std::vector<uint32_t> missing_in_group_;
+
+        [[nodiscard]] bool is_recoverable() const {
+            if (missing_total_ == 0) {
+                return true;
+            }
+            for (uint32_t group = 0; group < num_parity_; ++group) {
+                if (missing_in_group_[group] > 1 || (missing_in_group_[group] == 1 && !parity_present_[group])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+}
+
+std::unique_ptr<FecEncoder> make_fec_encoder(const FecScheme scheme, const std::span<const std::byte> chunk,
+                                             const uint16_t symbol_size) {
+    switch (scheme) {
+        case FecScheme::Wirehair: {
+            ensureWirehairInit();
+            const WirehairCodec codec = wirehair_encoder_create(nullptr, chunk.data(), chunk.size(), symbol_size);
+            if (!codec) {
+                throw std::runtime_error("wirehair_encoder_create() failed");
+            }
+            return std::make_unique<WirehairFecEncoder>(codec);
+        }
+        case FecScheme::Parity:
+            return std::make_unique<ParityFecEncoder>(chunk, symbol_size);
+        case FecScheme::None:
+            break;
+    }
+    return nullptr;
+}
+
+std::unique_ptr<FecDecoder> make_fec_decoder(const FecScheme scheme, const uint32_t chunk_size,
+                                             const uint16_t symbol_size) {
+    switch (scheme) {
+        case FecScheme::Wirehair:
+            return std::make_unique<WirehairFecDecoder>(chunk_size, symbol_size);
+        case FecScheme::Parity:
+            return std::make_unique<ParityFecDecoder>(chunk_size, symbol_size);
+        case FecScheme::None:
+            break;
+    }
+    return nullptr;
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of yt-media-storage, a tool for encoding media.
+ * Copyright (C) Brandon Li <https://brandonli.me/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+
+// Forward error correction applied to each chunk. Every scheme is systematic: symbols
+// 0..N-1 are the chunk itself, so a clean channel never touches the repair path.
+// The scheme is recorded in the FecSchemeMask bits of every packet's flags.
+enum class FecScheme : uint8_t {
+    Wirehair = 0,
+    None = 1,
+    Parity = 2,
+};
+
+[[nodiscard]] std::optional<FecScheme> fec_scheme_from_flags(uint8_t flags);
+
+[[nodiscard]] uint8_t fec_scheme_flags(FecScheme scheme);
+
+[[nodiscard]] std::optional<FecScheme> parse_fec_scheme(std::string_view name);
+
+[[nodiscard]] const char *fec_scheme_name(FecScheme scheme);
+
+[[nodiscard]] uint32_t fec_repair_count(FecScheme scheme, uint32_t num_source);
+
+class FecEncoder {
+public:
+    virtual ~FecEncoder() = default;
+
+    // Writes repair symbol esi (>= N) into out and returns the bytes written, or 0 on failure.
+    [[nodiscard]] virtual uint32_t encode_repair(uint32_t esi, std::span<std::byte> out) = 0;
+};
+
+class FecDecoder {
+public:
+    virtual ~FecDecoder() = default;
+
+    // Returns true once enough symbols have arrived for recover() to succeed.
+    [[nodiscard]] virtual bool add_symbol(uint32_t esi, std::span<const std::byte> payload) = 0;
+
+    virtual void recover(std::span<std::byte> out) = 0;
+
+    // Reuses a recovered decoder's state as an encoder for the same chunk, or nullptr when the
+    // scheme has nothing worth reusing and a fresh encoder is just as cheap.
+    [[nodiscard]] virtual std::unique_ptr<FecEncoder> into_encoder() { return nullptr; }
+};
+
+// Both return nullptr for FecScheme::None, which carries no repair symbols.
+[[nodiscard]] std::unique_ptr<FecEncoder> make_fec_encoder(FecScheme scheme, std::span<const std::byte> chunk,
+                                                           uint16_t symbol_size);
+
+[[nodiscard]] std::unique_ptr<FecDecoder> make_fec_decoder(FecScheme scheme, uint32_t chunk_size,
+                                                           uint16_t symbol_size);
@@ -20,8 +20,10 @@
 #include "libs/picosha2.h"
 #include "libs/CRC.h"
 
+#include <algorithm>
 #include <array>
 #include <cstring>
+#include <vector>
 
 static std::string bytes_to_hex(const std::span<const std::byte> inputBytes) {
     std::string hexString(inputBytes.size() * 2, 0);
@@ -101,6 +103,41 @@ uint32_t packet_crc32c(const std::span<const std::byte> header,
     return crc;
 }
 
+uint32_t crc32c_flip_delta(const std::size_t bytes_to_end, const uint8_t mask) {
+    // Starting from a zero register, leading zero bytes leave it at zero, so only the flipped
+    // byte and the zeros after it contribute. Every packet fits in the precomputed range.
+    static constexpr std::size_t TABLE_BYTES = 512;
+    static const auto deltas = [] {
+        const CRC::Table<uint32_t, 32> table(CRC::CRC_32_MPEG2());
+        constexpr uint8_t zero = 0;
+        std::vector<std::array<uint32_t, 8> > result(TABLE_BYTES + 1);
+        for (int bit = 0; bit < 8; ++bit) {
+            const auto single = static_cast<uint8_t>(1u << bit);
+            result[1][bit] = CRC::Calculate(&single, 1, table, 0u);
+            for (std::size_t length = 2; length <= TABLE_BYTES; ++length) {
+                result[length][bit] = CRC::Calculate(&zero, 1, table, result[length - 1][bit]);
+            }
+        }
+        return result;
+    }();
+
+    if (bytes_to_end == 0) {
+        return 0;
+    }
+    if (bytes_to_end > TABLE_BYTES) {
+        std::vector<uint8_t> message(bytes_to_end, 0);
+        message[0] = mask;
+        return CRC::Calculate(message.data(), message.size(), CRC::CRC_32_MPEG2(), 0u);
+    }
+    uint32_t delta = 0;
+    for (int bit = 0; bit < 8; ++bit) {
+        if ((mask >> bit) & 1u) {
+            delta ^= deltas[bytes_to_end][bit];
+        }
+    }
+    return delta;
+}
+
 uint32_t read_u32_le(const std::span<const std::byte> buffer, const std::size_t byteOffset) {
     uint32_t value = 0;
     if (byteOffset + 4 <= buffer.size()) {
@@ -50,4 +50,8 @@ bool verify_packet_crc32c(std::span<const std::byte> header,
                           std::size_t crc_offset,
                           std::size_t crc_size = 4);
 
+// How packet_crc32c changes when a bit in `mask` is flipped in a byte followed by `bytes_to_end - 1`
+// more bytes of CRC input. The CRC is affine, so the changes of several flips XOR together.
+uint32_t crc32c_flip_delta(std::size_t bytes_to_end, uint8_t mask);
+
 Sha256Digest sha256(std::span<const std::byte> data);
@@ -18,21 +18,30 @@
 // Created by brand on 2/5/2026.
 //
 
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
 #include <sstream>
 #include <string>
 #include <vector>
-#include <cstring>
 
 #include "chunker.h"
+#include "codec_profile.h"
 #include "configuration.h"
 #include "crypto.h"
+#include "decode_pipeline.h"
+#include "decode_report.h"
 #include "decoder.h"
 #include "encoder.h"
+#include "fec.h"
+#include "stream_input.h"
 #include "video_encoder.h"
 #include "video_decoder.h"
 
@@ -49,6 +58,11 @@ static std::string format_size(const std::uintmax_t bytes) {
     return oss.str();
 }
 
+// Decoder::expected_chunks() is 0 until a valid LastChunk packet has been seen.
+static std::string format_chunk_count(const uint32_t count) {
+    return count > 0 ? std::to_string(count) : "unknown";
+}
+
 static std::array<std::byte, 16> make_file_id() {
     std::array<std::byte, 16> id{};
     for (int i = 0; i < 16; ++i) {
@@ -59,12 +73,29 @@ static std::array<std::byte, 16> make_file_id() {
 
 static void print_usage(const char *program) {
     std::cerr << "Usage:\n"
-            << "  " << program << " encode --input <file> --output <video> [--encrypt --password <pwd>]\n"
-            << "  " << program << " decode --input <video> --output <file> [--password <pwd>]\n";
+            << "  " << program << " encode --input <file> --output <video> [--encrypt --password <pwd>]"
+            << " [--fec <wirehair|none|parity>] [--profile <name>] [--frame-size <WxH>] [--bits-per-block <1-4>]"
+            << " [--direct <1|2|4|8>] [--chroma] [--audio <flac|pcm>] [--codec-threads <n>] [--slices <n>]"
+            << " [--no-slice-crc] [--encode-queue <frames>] [--write-behind <MiB>]\n"
+            << "  " << program << " decode --input <video> [--input <video>...] --output <file> [--password <pwd>]"
+            << " [--memory-budget <MiB>] [--threads <n>] [--skip-repair-frames] [--soft-repair]"
+            << " [--report <json>] [--read-ahead <MiB>] [--codec-threads <n>]\n"
+            << "  " << program << " heal --input <video> --output <video> [--memory-budget <MiB>] [--threads <n>]"
+            << " [--skip-repair-frames] [--soft-repair] [--read-ahead <MiB>] [--profile <name>]"
+            << " [--frame-size <WxH>] [--bits-per-block <1-4>] [--direct <1|2|4|8>] [--chroma] [--audio <flac|pcm>]"
+            << " [--codec-threads <n>] [--slices <n>] [--no-slice-crc] [--encode-queue <frames>] [--write-behind <MiB>]\n"
+            << "  Input videos may be http(s) URLs or - for stdin; these are decoded while downloading.\n"
+            << "  Output videos may be http(s) URLs (uploaded with PUT) or - for stdout; these are written while"
+            << " encoding.\n"
+            << "Codec profiles:\n";
+    for (const auto &profile: codec_profiles()) {
+        std::cerr << "  " << std::left << std::setw(15) << profile.name << profile.description << "\n";
+    }
 }
 
 static int do_encode(const std::string &input_path, const std::string &output_path,
-                     bool encrypt, const std::string &password) {
+                     bool encrypt, const std::string &password, const FecScheme fec,
+                     const VideoEncoderOptions &video_options) {
     if (!std::filesystem::exists(input_path)) {
         std::cerr << "Error: input file not found: " << input_path << "\n";
         return 1;
@@ -79,7 +110,9 @@ static int do_encode(const std::string &input_path, const std::string &output_pa
     std::cout << "Chunks: " << num_chunks << "\n";
 
     const auto file_id = make_file_id();
-    const Encoder encoder(file_id);
+    const Encoder encoder(file_id, fec);
+    std::cout << "FEC: " << fec_scheme_name(fec) << "\n";
+    std::cout << "Codec profile: " << video_options.profile << "\n";
     std::vector<std::vector<Packet> > all_chunk_packets(num_chunks);
 
     std::array<std::byte, CRYPTO_KEY_BYTES> key{};
@@ -109,14 +142,16 @@ static int do_encode(const std::string &input_path, const std::string &output_pa
         total_packets += packets.size();
     std::cout << "Packets: " << total_packets << "\n";
 
+    uint64_t video_size = 0;
     try {
-        VideoEncoder video_encoder(output_path);
+        VideoEncoder video_encoder(output_path, video_options);
         for (auto &packets: all_chunk_packets) {
             video_encoder.encode_packets(packets);
             packets.clear();
             packets.shrink_to_fit();
         }
         video_encoder.finalize();
+        video_size = video_encoder.bytes_written();
     } catch (const std::exception &e) {
         if (encrypt) {
             secure_zero(std::span<std::byte>(key));
@@ -129,7 +164,6 @@ static int do_encode(const std::string &input_path, const std::string &output_pa
         secure_zero(std::span<std::byte>(key));
     }
 
-    const auto video_size = std::filesystem::file_size(output_path);
     std::cout << "\nEncode complete: " << format_size(input_size) << " -> "
             << format_size(video_size) << "\n";
     std::cout << "Written to: " << output_path << "\n";
@@ -137,85 +171,147 @@ static int do_encode(const std::string &input_path, const std::string &output_pa
     return 0;
 }
 
-static int do_decode(const std::string &input_path, const std::string &output_path,
-                     const std::string &password) {
+static bool write_report(const DecodeReport &report, const Decoder &decoder, const std::string &report_path) {
+    std::ofstream out(report_path);
+    if (!out) {
+        std::cerr << "Error: could not open " << report_path << " for writing\n";
+        return false;
+    }
+    report.write(out, decoder);
+    std::cout << "Report written to: " << report_path << "\n";
+    return true;
+}
+
+// Local videos are checked and sized up front; streamed inputs are only known once opened.
+static bool check_input_video(const std::string &input_path, std::uintmax_t &video_size) {
+    if (StreamInput::is_stream_url(input_path)) {
+        std::cout << "Input: " << input_path << " (streamed)\n";
+        return true;
+    }
     if (!std::filesystem::exists(input_path)) {
         std::cerr << "Error: input video not found: " << input_path << "\n";
-        return 1;
+        return false;
     }
+    const auto size = std::filesystem::file_size(input_path);
+    std::cout << "Input: " << input_path << " (" << format_size(size) << ")\n";
+    video_size += size;
+    return true;
+}
 
-    const auto video_size = std::filesystem::file_size(input_path);
-    std::cout << "Input: " << input_path << " (" << format_size(video_size) << ")\n";
+static int do_decode(const std::vector<std::string> &input_paths, const std::string &output_path,
+                     const std::string &password, const std::size_t memory_budget, const uint32_t threads,
+                     const bool skip_repair_frames, const bool soft_repair, const std::string &report_path,
+                     const std::size_t read_ahead, const int codec_threads) {
+    std::uintmax_t video_size = 0;
+    for (const auto &input_path: input_paths) {
+        if (!check_input_video(input_path, video_size)) {
+            return 1;
+        }
+    }
 
-    Decoder decoder;
+    Decoder decoder(memory_budget, threads);
+    decoder.set_scan_mode(output_path.empty());
     std::size_t total_extracted = 0;
     std::size_t decoded_chunks = 0;
-    uint32_t max_chunk_index = 0;
-    bool found_last_chunk = false;
-    uint32_t last_chunk_index = 0;
+    const bool reporting = !report_path.empty();
+    DecodeReport report;
+    report.set_inputs(input_paths);
 
     try {
-        VideoDecoder video_decoder(input_path);
-        const int64_t total = video_decoder.total_frames();
-        std::cout << "Total frames: "
-                << (total >= 0 ? std::to_string(total) : "unknown") << "\n";
+        std::vector<std::unique_ptr<VideoDecoder> > video_decoders;
+        std::vector<VideoDecoder *> videos;
+        for (const auto &input_path: input_paths) {
+            video_decoders.push_back(std::make_unique<VideoDecoder>(input_path, read_ahead, codec_threads));
+            videos.push_back(video_decoders.back().get());
+            videos.back()->set_soft_repair(soft_repair);
+            const int64_t total = videos.back()->total_frames();
+            std::cout << "Total frames: "
+                    << (total >= 0 ? std::to_string(total) : "unknown");
+            std::cout << (input_paths.size() > 1 ? " (" + input_path + ")\n" : "\n");
+        }
 
         std::size_t valid_frames = 0;
 
-        while (!video_decoder.is_eof()) {
-            if (auto frame_packets = video_decoder.decode_next_frame(); !frame_packets.empty()) {
-                ++valid_frames;
-                for (auto &pkt_data: frame_packets) {
-                    ++total_extracted;
-
-                    if (pkt_data.size() >= HEADER_SIZE) {
-                        const auto flags =
-                                static_cast<uint8_t>(pkt_data[FLAGS_OFF]);
-                        uint32_t chunk_idx = 0;
-                        std::memcpy(&chunk_idx,
-                                    pkt_data.data() + CHUNK_INDEX_OFF,
-                                    sizeof(chunk_idx));
-                        if (chunk_idx > max_chunk_index)
-                            max_chunk_index = chunk_idx;
-                        if (flags & LastChunk) {
-                            found_last_chunk = true;
-                            last_chunk_index = chunk_idx;
-                        }
-                    }
-
-                    const std::span<const std::byte> data(pkt_data.data(), pkt_data.size());
-                    if (auto result = decoder.process_packet(data);
-                        result && result->success) {
-                        ++decoded_chunks;
-                    }
+        DecodePipeline pipeline(decoder);
+        pipeline.set_skip_repair_frames(skip_repair_frames);
+        pipeline.run(
+            videos,
+            [&](const std::size_t source, const std::size_t packets) {
+                if (packets > 0) {
+                    ++valid_frames;
+                }
+                if (reporting) {
+                    report.begin_frame(source, videos[source]->current_frame(), videos[source]->frame_stats());
+                }
+            },
+            [&](const std::span<const std::byte> pkt_data) {
+                ++total_extracted;
+                if (reporting) {
+                    report.add_packet(pkt_data);
                 }
+            },
+            [&](ChunkDecodeResult &&) { ++decoded_chunks; });
+
+        int64_t frames_read = 0;
+        std::size_t packets_repaired = 0;
+        for (const auto *video: videos) {
+            frames_read += video->frames_read();
+            packets_repaired += video->packets_repaired();
+            video_size += video->bytes_streamed();
+        }
+        if (videos.size() > 1) {
+            for (std::size_t i = 0; i < videos.size(); ++i) {
+                std::cout << "Frames read from " << input_paths[i] << ": " << videos[i]->frames_read() << "\n";
             }
         }
-
         std::cout << "Valid frames: " << valid_frames << "\n";
         std::cout << "Packets extracted: " << total_extracted << "\n";
+        std::cout << "Packets skipped (chunk complete): " << decoder.packets_skipped_completed() << "\n";
+        if (decoder.packets_foreign_file() > 0) {
+            std::cout << "Packets dropped (different file): " << decoder.packets_foreign_file() << "\n";
+        }
+        if (soft_repair) {
+            std::cout << "Packets repaired (soft decision): " << packets_repaired << "\n";
+        }
+        if (pipeline.frames_skipped() > 0) {
+            std::cout << "Frames skipped (repair only): " << pipeline.frames_skipped() << "\n";
+        }
+        if (pipeline.stopped_early()) {
+            std::cout << "All chunks complete, stopped after " << frames_read << " frames\n";
+        }
+
+        report.set_frames(frames_read, pipeline.frames_skipped(), pipeline.stopped_early());
+        report.add_stage("read", pipeline.stage_times().read_seconds);
+        report.add_stage("fec", pipeline.stage_times().fec_seconds);
+        report.add_stage("collect", pipeline.stage_times().write_seconds);
     } catch (const std::exception &e) {
         std::cerr << "Error reading video: " << e.what() << "\n";
         return 1;
     }
 
+    // Without --output the run only scans the video, so the report is all there is to produce.
+    if (reporting && output_path.empty()) {
+        if (!write_report(report, decoder, report_path)) {
+            return 1;
+        }
+        return decoder.all_chunks_complete() ? 0 : 1;
+    }
+
     if (total_extracted == 0) {
         std::cerr << "No packets could be extracted from the video\n";
         return 1;
     }
 
-    uint32_t expected_chunks;
-    if (found_last_chunk) {
-        expected_chunks = last_chunk_index + 1;
-    } else {
-        expected_chunks = max_chunk_index + 1;
-    }
-
-    std::cout << "Chunks decoded: " << decoded_chunks << "/" << expected_chunks << "\n";
+    // Only a LastChunk packet that passed its CRC sets the count, so a corrupted one cannot.
+    const uint32_t expected_chunks = decoder.expected_chunks();
+    std::cout << "Chunks decoded: " << decoded_chunks << "/" << format_chunk_count(expected_chunks) << "\n";
 
-    if (decoded_chunks < expected_chunks) {
+    if (!decoder.all_chunks_complete()) {
+        if (reporting) {
+            write_report(report, decoder, report_path);
+        }
         std::cerr << "Error: only decoded " << decoded_chunks << " of "
-                << expected_chunks << " chunks\n";
+                << format_chunk_count(expected_chunks) << " chunks\n";
         return 1;
     }
 
@@ -231,7 +327,13 @@ static int do_decode(const std::string &input_path, const std::string &output_pa
         secure_zero(std::span<std::byte>(key));
     }
 
+    const auto assemble_started = std::chrono::steady_clock::now();
     auto assembled = decoder.assemble_file(expected_chunks);
+    report.add_stage("assemble",
+                     std::chrono::duration<double>(std::chrono::steady_clock::now() - assemble_started).count());
+    if (reporting && !write_report(report, decoder, report_path)) {
+        return 1;
+    }
     if (!assembled) {
         if (decoder.is_encrypted()) {
             decoder.clear_decrypt_key();
@@ -262,6 +364,100 @@ static int do_decode(const std::string &input_path, const std::string &output_pa
     return 0;
 }
 
+static int do_heal(const std::string &input_path, const std::string &output_path,
+                   const std::size_t memory_budget, const uint32_t threads, const bool skip_repair_frames,
+                   const bool soft_repair, const std::size_t read_ahead,
+                   const VideoEncoderOptions &video_options) {
+    std::uintmax_t video_size = 0;
+    if (!check_input_video(input_path, video_size)) {
+        return 1;
+    }
+    uint64_t healed_size = 0;
+
+    Decoder decoder(memory_budget, threads);
+    decoder.set_heal_mode(true);
+    std::optional<Encoder> encoder;
+    std::size_t total_extracted = 0;
+    std::size_t healed_chunks = 0;
+    std::size_t reused_codecs = 0;
+
+    try {
+        VideoDecoder video_decoder(input_path, read_ahead, video_options.codec_threads);
+        video_decoder.set_soft_repair(soft_repair);
+        VideoEncoder video_encoder(output_path, video_options);
+        const int64_t total = video_decoder.total_frames();
+        std::cout << "Total frames: "
+                << (total >= 0 ? std::to_string(total) : "unknown") << "\n";
+
+        // Re-encoding runs on the pipeline's writer thread, so it overlaps with decoding.
+        DecodePipeline pipeline(decoder);
+        pipeline.set_skip_repair_frames(skip_repair_frames);
+        pipeline.run(
+            video_decoder,
+            [](std::size_t, std::size_t) {
+            },
+            [&](const std::span<const std::byte> pkt_data) {
+                ++total_extracted;
+            },
+            [&](ChunkDecodeResult &&result) {
+                if (!encoder) {
+                    encoder.emplace(*decoder.file_id(),
+                                    fec_scheme_from_flags(result.flags).value_or(FecScheme::Wirehair));
+                }
+                auto [packets, manifest] = encoder->encode_chunk(
+                    result.chunk_index, result.data, (result.flags & LastChunk) != 0,
+                    (result.flags & Encrypted) != 0, result.encoder.get());
+                video_encoder.encode_packets(packets);
+                if (result.encoder) {
+                    ++reused_codecs;
+                }
+                ++healed_chunks;
+            });
+
+        video_encoder.finalize();
+        healed_size = video_encoder.bytes_written();
+        video_size += video_decoder.bytes_streamed();
+        std::cout << "Packets extracted: " << total_extracted << "\n";
+        std::cout << "Packets skipped (chunk complete): " << decoder.packets_skipped_completed() << "\n";
+        if (decoder.packets_foreign_file() > 0) {
+            std::cout << "Packets dropped (different file): " << decoder.packets_foreign_file() << "\n";
+        }
+        if (soft_repair) {
+            std::cout << "Packets repaired (soft decision): " << video_decoder.packets_repaired() << "\n";
+        }
+        if (pipeline.frames_skipped() > 0) {
+            std::cout << "Frames skipped (repair only): " << pipeline.frames_skipped() << "\n";
+        }
+        if (pipeline.stopped_early()) {
+            std::cout << "All chunks complete, stopped after frame " << video_decoder.frames_read() << "\n";
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error healing video: " << e.what() << "\n";
+        return 1;
+    }
+
+    if (total_extracted == 0) {
+        std::cerr << "No packets could be extracted from the video\n";
+        return 1;
+    }
+
+    const uint32_t expected_chunks = decoder.expected_chunks();
+    std::cout << "Chunks healed: " << healed_chunks << "/" << format_chunk_count(expected_chunks)
+            << " (" << reused_codecs << " re-encoded from their decoder)\n";
+
+    if (!decoder.all_chunks_complete()) {
+        std::cerr << "Error: only recovered " << healed_chunks << " of "
+                << format_chunk_count(expected_chunks) << " chunks; " << output_path << " is incomplete\n";
+        return 1;
+    }
+
+    std::cout << "\nHeal complete: " << format_size(video_size) << " -> "
+            << format_size(healed_size) << "\n";
+    std::cout << "Written to: " << output_path << "\n";
+
+    return 0;
+}
+
 int main(const int argc, char *argv[]) {
     if (argc < 2) {
         print_usage(argv[0]);
@@ -270,26 +466,154 @@ int main(const int argc, char *argv[]) {
 
     const std::string command = argv[1];
 
-    if (command != "encode" && command != "decode") {
+    if (command != "encode" && command != "decode" && command != "heal") {
         std::cerr << "Error: unknown command '" << command << "'\n";
         print_usage(argv[0]);
         return 1;
     }
 
-    std::string input_path;
+    std::vector<std::string> input_paths;
     std::string output_path;
     bool encrypt = false;
     std::string password;
+    std::size_t memory_budget = DECODER_MEMORY_BUDGET_BYTES;
+    std::size_t read_ahead = STREAM_READ_AHEAD_BYTES;
+    VideoEncoderOptions video_options;
+    uint32_t threads = DecodePipeline::default_shards();
+    bool skip_repair_frames = false;
+    bool soft_repair = false;
+    std::string report_path;
+    FecScheme fec = FecScheme::Wirehair;
 
     for (int i = 2; i < argc; ++i) {
         if (const std::string arg = argv[i]; (arg == "--input" || arg == "-i") && i + 1 < argc) {
-            input_path = argv[++i];
+            input_paths.emplace_back(argv[++i]);
         } else if ((arg == "--output" || arg == "-o") && i + 1 < argc) {
             output_path = argv[++i];
         } else if ((arg == "--encrypt" || arg == "-e")) {
             encrypt = true;
         } else if ((arg == "--password" || arg == "-p") && i + 1 < argc) {
             password = argv[++i];
+        } else if (arg == "--fec" && i + 1 < argc) {
+            const auto scheme = parse_fec_scheme(argv[++i]);
+            if (!scheme) {
+                std::cerr << "Error: unknown FEC scheme '" << argv[i] << "'\n";
+                print_usage(argv[0]);
+                return 1;
+            }
+            fec = *scheme;
+        } else if (arg == "--profile" && i + 1 < argc) {
+            if (!find_codec_profile(argv[++i])) {
+                std::cerr << "Error: unknown codec profile '" << argv[i] << "'\n";
+                print_usage(argv[0]);
+                return 1;
+            }
+            video_options.profile = argv[i];
+        } else if (arg == "--memory-budget" && i + 1 < argc) {
+            try {
+                memory_budget = std::stoull(argv[++i]) * 1024ull * 1024ull;
+            } catch (const std::exception &) {
+                std::cerr << "Error: --memory-budget expects a size in MiB\n";
+                return 1;
+            }
+        } else if (arg == "--read-ahead" && i + 1 < argc) {
+            try {
+                read_ahead = std::stoull(argv[++i]) * 1024ull * 1024ull;
+            } catch (const std::exception &) {
+                std::cerr << "Error: --read-ahead expects a size in MiB\n";
+                return 1;
+            }
+        } else if (arg == "--write-behind" && i + 1 < argc) {
+            try {
+                video_options.write_behind = std::stoull(argv[++i]) * 1024ull * 1024ull;
+            } catch (const std::exception &) {
+                std::cerr << "Error: --write-behind expects a size in MiB\n";
+                return 1;
+            }
+        } else if ((arg == "--codec-threads" || arg == "--slices" || arg == "--encode-queue") && i + 1 < argc) {
+            int value = -1;
+            try {
+                value = std::stoi(argv[++i]);
+            } catch (const std::exception &) {
+            }
+            if (value < 0 || (value == 0 && arg != "--codec-threads")) {
+                std::cerr << "Error: " << arg << " expects a "
+                        << (arg == "--codec-threads" ? "non-negative" : "positive") << " count\n";
+                return 1;
+            }
+            if (arg == "--codec-threads") {
+                video_options.codec_threads = value;
+            } else if (arg == "--slices") {
+                video_options.slices = value;
+            } else {
+                video_options.queue_frames = static_cast<std::size_t>(value);
+            }
+        } else if (arg == "--bits-per-block" && i + 1 < argc) {
+            try {
+                video_options.bits_per_block = std::stoi(argv[++i]);
+            } catch (const std::exception &) {
+                video_options.bits_per_block = 0;
+            }
+            if (video_options.bits_per_block < 1 || video_options.bits_per_block > MAX_BITS_PER_BLOCK) {
+                std::cerr << "Error: --bits-per-block expects 1 to " << MAX_BITS_PER_BLOCK << "\n";
+                return 1;
+            }
+        } else if (arg == "--frame-size" && i + 1 < argc) {
+            const std::string size = argv[++i];
+            const std::size_t x = size.find('x');
+            try {
+                if (x == std::string::npos) {
+                    throw std::invalid_argument(size);
+                }
+                video_options.frame_width = std::stoi(size.substr(0, x));
+                video_options.frame_height = std::stoi(size.substr(x + 1));
+                compute_frame_layout(DEFAULT_BITS_PER_BLOCK, video_options.frame_width, video_options.frame_height);
+            } catch (const std::exception &) {
+                std::cerr << "Error: --frame-size expects WIDTHxHEIGHT, each a multiple of 8 up to "
+                        << MAX_FRAME_DIMENSION << "\n";
+                return 1;
+            }
+        } else if (arg == "--direct" && i + 1 < argc) {
+            try {
+                video_options.direct_bits_per_pixel = std::stoi(argv[++i]);
+            } catch (const std::exception &) {
+                video_options.direct_bits_per_pixel = 0;
+            }
+            if (const int bits = video_options.direct_bits_per_pixel;
+                bits != 1 && bits != 2 && bits != 4 && bits != 8) {
+                std::cerr << "Error: --direct expects 1, 2, 4 or 8 bits per pixel\n";
+                return 1;
+            }
+        } else if (arg == "--chroma") {
+            video_options.chroma = true;
+        } else if (arg == "--audio" && i + 1 < argc) {
+            const std::string track = argv[++i];
+            if (track == "flac") {
+                video_options.audio = AudioTrack::Flac;
+            } else if (track == "pcm") {
+                video_options.audio = AudioTrack::Pcm;
+            } else {
+                std::cerr << "Error: --audio expects flac or pcm\n";
+                return 1;
+            }
+        } else if (arg == "--no-slice-crc") {
+            video_options.slice_crc = false;
+        } else if (arg == "--report" && i + 1 < argc) {
+            report_path = argv[++i];
+        } else if (arg == "--skip-repair-frames") {
+            skip_repair_frames = true;
+        } else if (arg == "--soft-repair") {
+            soft_repair = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            try {
+                threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+            } catch (const std::exception &) {
+                threads = 0;
+            }
+            if (threads == 0) {
+                std::cerr << "Error: --threads expects a positive count\n";
+                return 1;
+            }
         } else {
             std::cerr << "Error: unknown or incomplete argument '" << arg << "'\n";
             print_usage(argv[0]);
@@ -297,20 +621,41 @@ int main(const int argc, char *argv[]) {
         }
     }
 
-    if (input_path.empty() || output_path.empty()) {
+    // A decode with --report may leave out --output to only scan the video.
+    if (input_paths.empty() || (output_path.empty() && (command != "decode" || report_path.empty()))) {
         std::cerr << "Error: both --input and --output must be specified\n";
         print_usage(argv[0]);
         return 1;
     }
 
+    // Only decode merges several copies of the same video; the other commands take one input.
+    if (input_paths.size() > 1 && command != "decode") {
+        std::cerr << "Error: " << command << " takes a single --input\n";
+        return 1;
+    }
+
+    if (std::ranges::count(input_paths, std::string("-")) > 1) {
+        std::cerr << "Error: stdin can only be read as one --input\n";
+        return 1;
+    }
+
     if (encrypt && password.empty()) {
         std::cerr << "Error: --encrypt requires --password\n";
         return 1;
     }
 
+    // A video written to stdout must not be mixed with progress output, so that goes to stderr.
+    if (command != "decode" && output_path == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
     if (command == "encode") {
-        return do_encode(input_path, output_path, encrypt, password);
+        return do_encode(input_paths.front(), output_path, encrypt, password, fec, video_options);
+    } else if (command == "heal") {
+        return do_heal(input_paths.front(), output_path, memory_budget, threads, skip_repair_frames, soft_repair,
+                       read_ahead, video_options);
     } else {
-        return do_decode(input_path, output_path, password);
+        return do_decode(input_paths, output_path, password, memory_budget, threads, skip_repair_frames,
+                         soft_repair, report_path, read_ahead, video_options.codec_threads);
     }
 }
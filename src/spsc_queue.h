@@ -0,0 +1,111 @@
+/*
+ * This file is part of yt-media-storage, a tool for encoding media.
+ * Copyright (C) Brandon Li <https://brandonli.me/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bounded single-producer/single-consumer ring. Elements are written and read in place, so a
+// slot type with a fixed buffer moves through the queue without extra copies. A full producer
+// or an empty consumer sleeps on an atomic wait instead of spinning. A consumer that drains
+// several queues can pass one shared `consumer_signal` to all of them and wait on that.
+template<typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(const std::size_t capacity, std::atomic<uint32_t> *consumer_signal = nullptr)
+        : slots_(std::bit_ceil(std::max<std::size_t>(2, capacity)))
+          , mask_(slots_.size() - 1)
+          , signal_(consumer_signal ? consumer_signal : &own_signal_) {
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // Producer side: fill(T &) writes the next element. Blocks while the queue is full.
+    template<typename Fill>
+    void push(Fill &&fill) {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        std::size_t head = head_.load(std::memory_order_acquire);
+        while (tail - head == slots_.size()) {
+            head_.wait(head, std::memory_order_acquire);
+            head = head_.load(std::memory_order_acquire);
+        }
+        fill(slots_[tail & mask_]);
+        tail_.store(tail + 1, std::memory_order_release);
+        wake_consumer();
+    }
+
+    // Consumer side: consume(T &) reads the next element. Blocks while the queue is empty and
+    // returns false once it is closed and drained.
+    template<typename Consume>
+    bool pop(Consume &&consume) {
+        while (true) {
+            const uint32_t seen = signal_->load(std::memory_order_acquire);
+            if (try_pop(consume)) {
+                return true;
+            }
+            if (closed_.load(std::memory_order_acquire)) {
+                return try_pop(consume);
+            }
+            signal_->wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    template<typename Consume>
+    bool try_pop(Consume &&consume) {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (tail_.load(std::memory_order_acquire) == head) {
+            return false;
+        }
+        consume(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        head_.notify_one();
+        return true;
+    }
+
+    // Producer side: no more elements will be pushed.
+    void close() {
+        closed_.store(true, std::memory_order_release);
+        wake_consumer();
+    }
+
+    [[nodiscard]] bool drained() const {
+        return closed_.load(std::memory_order_acquire) &&
+               tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> slots_;
+    std::size_t mask_;
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    alignas(64) std::atomic<uint32_t> own_signal_{0};
+    std::atomic<uint32_t> *signal_;
+    std::atomic<bool> closed_{false};
+
+    void wake_consumer() {
+        signal_->fetch_add(1, std::memory_order_release);
+        signal_->notify_one();
+    }
+};
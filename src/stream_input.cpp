@@ -0,0 +1,134 @@
+// This file is part of yt-media-storage, a tool for encoding media.
+// Copyright (C) Brandon Li <https://brandonli.me/>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "stream_input.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/mem.h>
+}
+
+#include "configuration.h"
+
+bool StreamInput::is_stream_url(const std::string &path) {
+    return path == "-" || path.find("://") != std::string::npos || path.starts_with("pipe:");
+}
+
+StreamInput::StreamInput(const std::string &url, const std::size_t read_ahead)
+    : ring_(std::max<std::size_t>(read_ahead, STREAM_FETCH_BLOCK_BYTES)) {
+    avformat_network_init();
+
+    // Lets the destructor abort a download that is blocked on the network.
+    const AVIOInterruptCB interrupt{&StreamInput::interrupted, this};
+    const std::string source_url = url == "-" ? "pipe:0" : url;
+    if (avio_open2(&source_, source_url.c_str(), AVIO_FLAG_READ, &interrupt, nullptr) < 0) {
+        avformat_network_deinit();
+        throw std::runtime_error("Failed to open input stream: " + url);
+    }
+
+    auto *buffer = static_cast<unsigned char *>(av_malloc(STREAM_AVIO_BUFFER_BYTES));
+    if (buffer) {
+        context_ = avio_alloc_context(buffer, static_cast<int>(STREAM_AVIO_BUFFER_BYTES), 0, this,
+                                      &StreamInput::read_packet, nullptr, nullptr);
+    }
+    if (!context_) {
+        av_free(buffer);
+        avio_closep(&source_);
+        avformat_network_deinit();
+        throw std::runtime_error("Failed to allocate stream I/O context");
+    }
+    context_->seekable = 0;
+
+    fetcher_ = std::jthread([this] { fetch(); });
+}
+
+StreamInput::~StreamInput() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_.store(true, std::memory_order_relaxed);
+    }
+    space_ready_.notify_all();
+    if (fetcher_.joinable()) {
+        fetcher_.join();
+    }
+    av_freep(&context_->buffer);
+    avio_context_free(&context_);
+    avio_closep(&source_);
+    avformat_network_deinit();
+}
+
+int StreamInput::interrupted(void *opaque) {
+    return static_cast<StreamInput *>(opaque)->stop_.load(std::memory_order_relaxed) ? 1 : 0;
+}
+
+void StreamInput::fetch() {
+    std::vector<uint8_t> block(STREAM_FETCH_BLOCK_BYTES);
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            space_ready_.wait(lock, [&] {
+                return stop_.load(std::memory_order_relaxed) || write_pos_ - read_pos_ + block.size() <= ring_.size();
+            });
+            if (stop_.load(std::memory_order_relaxed)) {
+                return;
+            }
+        }
+
+        // The network read runs unlocked; room for a whole block was already checked above and
+        // only this thread adds data, so the copy below never overruns unread bytes.
+        const int n = avio_read_partial(source_, block.data(), static_cast<int>(block.size()));
+        if (n == 0) {
+            continue;
+        }
+
+        std::lock_guard lock(mutex_);
+        if (n < 0) {
+            status_ = n;
+            data_ready_.notify_all();
+            return;
+        }
+        const std::size_t at = write_pos_ % ring_.size();
+        const std::size_t first = std::min<std::size_t>(static_cast<std::size_t>(n), ring_.size() - at);
+        std::memcpy(ring_.data() + at, block.data(), first);
+        std::memcpy(ring_.data(), block.data() + first, static_cast<std::size_t>(n) - first);
+        write_pos_ += static_cast<uint64_t>(n);
+        received_.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+        data_ready_.notify_all();
+    }
+}
+
+int StreamInput::read_packet(void *opaque, uint8_t *buf, const int size) {
+    auto *self = static_cast<StreamInput *>(opaque);
+    std::unique_lock lock(self->mutex_);
+    self->data_ready_.wait(lock, [&] { return self->write_pos_ > self->read_pos_ || self->status_ != 0; });
+
+    const uint64_t available = self->write_pos_ - self->read_pos_;
+    if (available == 0) {
+        return self->status_;
+    }
+    const std::size_t n = std::min<std::size_t>(static_cast<std::size_t>(size), available);
+    const std::size_t at = self->read_pos_ % self->ring_.size();
+    const std::size_t first = std::min(n, self->ring_.size() - at);
+    std::memcpy(buf, self->ring_.data() + at, first);
+    std::memcpy(buf + first, self->ring_.data(), n - first);
+    self->read_pos_ += n;
+    self->space_ready_.notify_one();
+    return static_cast<int>(n);
+}
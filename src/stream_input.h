@@ -0,0 +1,74 @@
+/*
+ * This file is part of yt-media-storage, a tool for encoding media.
+ * Copyright (C) Brandon Li <https://brandonli.me/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+// Non-seekable input (an http(s) URL, "-" for stdin, or any other FFmpeg protocol URL) read by
+// a background thread into a bounded read-ahead ring. The demuxer reads from the ring through a
+// custom AVIOContext, so downloading overlaps decoding instead of preceding it.
+class StreamInput {
+public:
+    StreamInput(const std::string &url, std::size_t read_ahead);
+
+    ~StreamInput();
+
+    StreamInput(const StreamInput &) = delete;
+
+    StreamInput &operator=(const StreamInput &) = delete;
+
+    // True for inputs that should be streamed rather than opened as a local file.
+    [[nodiscard]] static bool is_stream_url(const std::string &path);
+
+    // Context to install as AVFormatContext::pb (with AVFMT_FLAG_CUSTOM_IO). Owned by this object.
+    [[nodiscard]] AVIOContext *context() const { return context_; }
+
+    [[nodiscard]] uint64_t bytes_received() const { return received_.load(std::memory_order_relaxed); }
+
+private:
+    AVIOContext *source_ = nullptr;
+    AVIOContext *context_ = nullptr;
+    std::vector<uint8_t> ring_;
+    uint64_t read_pos_ = 0;
+    uint64_t write_pos_ = 0;
+    int status_ = 0; // AVERROR_EOF or the error that ended the download, once it has ended
+    std::mutex mutex_;
+    std::condition_variable data_ready_;
+    std::condition_variable space_ready_;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> received_{0};
+    std::jthread fetcher_;
+
+    static int read_packet(void *opaque, uint8_t *buf, int size);
+
+    static int interrupted(void *opaque);
+
+    void fetch();
+};
@@ -0,0 +1,179 @@
+// This file is part of yt-media-storage, a tool for encoding media.
+// Copyright (C) Brandon Li <https://brandonli.me/>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "stream_output.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/dict.h>
+#include <libavutil/mem.h>
+}
+
+#include "configuration.h"
+
+bool StreamOutput::is_stream_url(const std::string &path) {
+    return path == "-" || path.find("://") != std::string::npos || path.starts_with("pipe:");
+}
+
+StreamOutput::StreamOutput(const std::string &url, const std::size_t write_behind)
+    : url_(url), ring_(std::max<std::size_t>(write_behind, STREAM_AVIO_BUFFER_BYTES)) {
+    avformat_network_init();
+
+    // HTTP uploads are a single PUT with a chunked body, so its length need not be known up front.
+    AVDictionary *options = nullptr;
+    if (url.starts_with("http://") || url.starts_with("https://")) {
+        av_dict_set(&options, "method", "PUT", 0);
+        av_dict_set(&options, "chunked_post", "1", 0);
+    }
+    // Lets the destructor abort an upload that is blocked on the network.
+    const AVIOInterruptCB interrupt{&StreamOutput::interrupted, this};
+    const std::string sink_url = url == "-" ? "pipe:1" : url;
+    const int ret = avio_open2(&sink_, sink_url.c_str(), AVIO_FLAG_WRITE, &interrupt, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        avformat_network_deinit();
+        throw std::runtime_error("Failed to open output stream: " + url);
+    }
+
+    auto *buffer = static_cast<unsigned char *>(av_malloc(STREAM_AVIO_BUFFER_BYTES));
+    if (buffer) {
+        context_ = avio_alloc_context(buffer, static_cast<int>(STREAM_AVIO_BUFFER_BYTES), 1, this,
+                                      nullptr, &StreamOutput::write_packet, nullptr);
+    }
+    if (!context_) {
+        av_free(buffer);
+        avio_closep(&sink_);
+        avformat_network_deinit();
+        throw std::runtime_error("Failed to allocate stream I/O context");
+    }
+    // Without a seek callback the muxer never goes back to patch sizes, so it writes a
+    // streamable file.
+    context_->seekable = 0;
+
+    drainer_ = std::jthread([this] { drain(); });
+}
+
+StreamOutput::~StreamOutput() {
+    if (!finished_) {
+        {
+            std::lock_guard lock(mutex_);
+            stop_.store(true, std::memory_order_relaxed);
+        }
+        data_ready_.notify_all();
+        space_ready_.notify_all();
+        if (drainer_.joinable()) {
+            drainer_.join();
+        }
+        avio_closep(&sink_);
+    }
+    av_freep(&context_->buffer);
+    avio_context_free(&context_);
+    avformat_network_deinit();
+}
+
+int StreamOutput::interrupted(void *opaque) {
+    return static_cast<StreamOutput *>(opaque)->stop_.load(std::memory_order_relaxed) ? 1 : 0;
+}
+
+void StreamOutput::finish() {
+    if (finished_) {
+        return;
+    }
+    avio_flush(context_);
+    {
+        std::lock_guard lock(mutex_);
+        closing_ = true;
+    }
+    data_ready_.notify_all();
+    if (drainer_.joinable()) {
+        drainer_.join();
+    }
+    const int ret = avio_closep(&sink_);
+    finished_ = true;
+    if (status_ < 0 || context_->error < 0 || ret < 0) {
+        throw std::runtime_error("Failed to write output stream: " + url_);
+    }
+}
+
+void StreamOutput::drain() {
+    std::vector<uint8_t> block(STREAM_FETCH_BLOCK_BYTES);
+    while (true) {
+        std::size_t n = 0;
+        {
+            std::unique_lock lock(mutex_);
+            data_ready_.wait(lock, [&] {
+                return stop_.load(std::memory_order_relaxed) || closing_ || write_pos_ > read_pos_;
+            });
+            if (stop_.load(std::memory_order_relaxed)) {
+                return;
+            }
+            n = std::min<std::size_t>(block.size(), write_pos_ - read_pos_);
+            if (n == 0) {
+                break;
+            }
+            const std::size_t at = read_pos_ % ring_.size();
+            const std::size_t first = std::min(n, ring_.size() - at);
+            std::memcpy(block.data(), ring_.data() + at, first);
+            std::memcpy(block.data() + first, ring_.data(), n - first);
+            read_pos_ += n;
+        }
+        space_ready_.notify_one();
+
+        // The network write runs unlocked, so the muxer can keep filling the ring meanwhile.
+        avio_write(sink_, block.data(), static_cast<int>(n));
+        if (sink_->error < 0) {
+            std::lock_guard lock(mutex_);
+            status_ = sink_->error;
+            space_ready_.notify_all();
+            return;
+        }
+        sent_.fetch_add(n, std::memory_order_relaxed);
+    }
+    avio_flush(sink_);
+    if (sink_->error < 0) {
+        std::lock_guard lock(mutex_);
+        status_ = sink_->error;
+    }
+}
+
+int StreamOutput::write_packet(void *opaque, const WriteBuffer buf, const int size) {
+    auto *self = static_cast<StreamOutput *>(opaque);
+    std::unique_lock lock(self->mutex_);
+    self->space_ready_.wait(lock, [&] {
+        return self->status_ != 0 || self->stop_.load(std::memory_order_relaxed) ||
+               self->write_pos_ - self->read_pos_ + static_cast<std::size_t>(size) <= self->ring_.size();
+    });
+    if (self->status_ != 0) {
+        return self->status_;
+    }
+    if (self->stop_.load(std::memory_order_relaxed)) {
+        return AVERROR_EXIT;
+    }
+
+    const auto n = static_cast<std::size_t>(size);
+    const std::size_t at = self->write_pos_ % self->ring_.size();
+    const std::size_t first = std::min(n, self->ring_.size() - at);
+    std::memcpy(self->ring_.data() + at, buf, first);
+    std::memcpy(self->ring_.data(), buf + first, n - first);
+    self->write_pos_ += n;
+    self->data_ready_.notify_one();
+    return size;
+}
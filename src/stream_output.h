@@ -0,0 +1,91 @@
+/*
+ * This file is part of yt-media-storage, a tool for encoding media.
+ * Copyright (C) Brandon Li <https://brandonli.me/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavformat/version.h>
+}
+
+// Non-seekable output ("-" for stdout, an http(s) URL uploaded with a chunked PUT, or any other
+// FFmpeg protocol URL). The muxer writes through a custom AVIOContext into a bounded write-behind
+// ring that a background thread drains into the sink, so uploading overlaps encoding and the
+// video never has to exist on local disk.
+class StreamOutput {
+public:
+    StreamOutput(const std::string &url, std::size_t write_behind);
+
+    ~StreamOutput();
+
+    StreamOutput(const StreamOutput &) = delete;
+
+    StreamOutput &operator=(const StreamOutput &) = delete;
+
+    // True for outputs that should be streamed rather than written to a local file.
+    [[nodiscard]] static bool is_stream_url(const std::string &path);
+
+    // Context to install as AVFormatContext::pb (with AVFMT_FLAG_CUSTOM_IO). Owned by this object.
+    [[nodiscard]] AVIOContext *context() const { return context_; }
+
+    // Drains everything written so far and closes the sink, which for an upload waits for the
+    // server's response. Throws if any write failed.
+    void finish();
+
+    [[nodiscard]] uint64_t bytes_sent() const { return sent_.load(std::memory_order_relaxed); }
+
+private:
+    // FFmpeg 7 made the write callback's buffer const.
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+    using WriteBuffer = const uint8_t *;
+#else
+    using WriteBuffer = uint8_t *;
+#endif
+
+    std::string url_;
+    AVIOContext *sink_ = nullptr;
+    AVIOContext *context_ = nullptr;
+    std::vector<uint8_t> ring_;
+    uint64_t read_pos_ = 0;
+    uint64_t write_pos_ = 0;
+    int status_ = 0; // the error that ended the upload, once one has
+    bool closing_ = false;
+    bool finished_ = false;
+    std::mutex mutex_;
+    std::condition_variable data_ready_;
+    std::condition_variable space_ready_;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> sent_{0};
+    std::jthread drainer_;
+
+    static int write_packet(void *opaque, WriteBuffer buf, int size);
+
+    static int interrupted(void *opaque);
+
+    void drain();
+};
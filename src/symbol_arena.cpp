@@ -0,0 +1,124 @@
+// This file is part of yt-media-storage, a tool for encoding media.
+// Copyright (C) Brandon Li <https://brandonli.me/>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "symbol_arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+static constexpr std::size_t ARENA_PAGE_BYTES = 1024ull * 1024ull;
+
+SymbolArena::SymbolArena(const std::size_t symbol_bytes)
+    : symbol_bytes_(symbol_bytes)
+      , slots_per_page_(std::max<std::size_t>(1, ARENA_PAGE_BYTES / std::max<std::size_t>(1, symbol_bytes))) {
+    if (symbol_bytes_ == 0) {
+        throw std::runtime_error("symbol size must be non-zero");
+    }
+}
+
+SymbolArena::~SymbolArena() {
+    if (spill_file_.is_open()) {
+        spill_file_.close();
+        std::error_code ec;
+        std::filesystem::remove(spill_path_, ec);
+    }
+}
+
+std::byte *SymbolArena::slot_data(const uint32_t slot) const {
+    return pages_[slot / slots_per_page_].get() + (slot % slots_per_page_) * symbol_bytes_;
+}
+
+uint32_t SymbolArena::store(const std::span<const std::byte> symbol) {
+    uint32_t slot;
+    if (!free_slots_.empty()) {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+    } else {
+        slot = next_slot_++;
+        if (slot / slots_per_page_ >= pages_.size()) {
+            pages_.push_back(std::make_unique<std::byte[]>(slots_per_page_ * symbol_bytes_));
+        }
+    }
+
+    std::byte *dest = slot_data(slot);
+    const std::size_t len = std::min(symbol.size(), symbol_bytes_);
+    std::memcpy(dest, symbol.data(), len);
+    std::memset(dest + len, 0, symbol_bytes_ - len);
+    ++resident_slots_;
+    return slot;
+}
+
+std::span<const std::byte> SymbolArena::view(const uint32_t slot) const {
+    return {slot_data(slot), symbol_bytes_};
+}
+
+void SymbolArena::release(const uint32_t slot) {
+    free_slots_.push_back(slot);
+    --resident_slots_;
+}
+
+void SymbolArena::open_spill_file() {
+    std::random_device rd;
+    const auto tag = (static_cast<uint64_t>(rd()) << 32) | rd();
+    spill_path_ = std::filesystem::temp_directory_path() /
+                  ("yt-media-storage-" + std::to_string(tag) + ".spill");
+    spill_file_.open(spill_path_, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+    if (!spill_file_) {
+        throw std::runtime_error("Failed to create spill file: " + spill_path_.string());
+    }
+}
+
+uint32_t SymbolArena::spill(const uint32_t slot) {
+    if (!spill_file_.is_open()) {
+        open_spill_file();
+    }
+
+    uint32_t spill_slot;
+    if (!free_spill_slots_.empty()) {
+        spill_slot = free_spill_slots_.back();
+        free_spill_slots_.pop_back();
+    } else {
+        spill_slot = next_spill_slot_++;
+    }
+
+    spill_file_.seekp(static_cast<std::streamoff>(spill_slot) * static_cast<std::streamoff>(symbol_bytes_));
+    spill_file_.write(reinterpret_cast<const char *>(slot_data(slot)),
+                      static_cast<std::streamsize>(symbol_bytes_));
+    if (!spill_file_) {
+        throw std::runtime_error("Failed to write spill file");
+    }
+
+    release(slot);
+    ++spilled_slots_;
+    return spill_slot;
+}
+
+void SymbolArena::load_spilled(const uint32_t spill_slot, const std::span<std::byte> out) {
+    spill_file_.seekg(static_cast<std::streamoff>(spill_slot) * static_cast<std::streamoff>(symbol_bytes_));
+    spill_file_.read(reinterpret_cast<char *>(out.data()),
+                     static_cast<std::streamsize>(std::min(out.size(), symbol_bytes_)));
+    if (!spill_file_) {
+        throw std::runtime_error("Failed to read spill file");
+    }
+}
+
+void SymbolArena::release_spilled(const uint32_t spill_slot) {
+    free_spill_slots_.push_back(spill_slot);
+    --spilled_slots_;
+}
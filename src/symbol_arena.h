@@ -0,0 +1,77 @@
+/*
+ * This file is part of yt-media-storage, a tool for encoding media.
+ * Copyright (C) Brandon Li <https://brandonli.me/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Fixed-size symbol slots shared by every partially received chunk. Slots live in
+// 1 MiB pages that are never moved, so spans stay valid until the slot is released.
+// Cold symbols can be moved to a temp file and read back when their chunk is solved.
+class SymbolArena {
+public:
+    explicit SymbolArena(std::size_t symbol_bytes);
+
+    ~SymbolArena();
+
+    SymbolArena(const SymbolArena &) = delete;
+
+    SymbolArena &operator=(const SymbolArena &) = delete;
+
+    [[nodiscard]] uint32_t store(std::span<const std::byte> symbol);
+
+    [[nodiscard]] std::span<const std::byte> view(uint32_t slot) const;
+
+    void release(uint32_t slot);
+
+    [[nodiscard]] uint32_t spill(uint32_t slot);
+
+    void load_spilled(uint32_t spill_slot, std::span<std::byte> out);
+
+    void release_spilled(uint32_t spill_slot);
+
+    [[nodiscard]] std::size_t symbol_bytes() const { return symbol_bytes_; }
+
+    [[nodiscard]] std::size_t resident_bytes() const { return resident_slots_ * symbol_bytes_; }
+
+    [[nodiscard]] std::size_t spilled_bytes() const { return spilled_slots_ * symbol_bytes_; }
+
+private:
+    std::size_t symbol_bytes_;
+    std::size_t slots_per_page_;
+    std::vector<std::unique_ptr<std::byte[]> > pages_;
+    std::vector<uint32_t> free_slots_;
+    uint32_t next_slot_ = 0;
+    std::size_t resident_slots_ = 0;
+
+    std::filesystem::path spill_path_;
+    std::fstream spill_file_;
+    std::vector<uint32_t> free_spill_slots_;
+    uint32_t next_spill_slot_ = 0;
+    std::size_t spilled_slots_ = 0;
+
+    [[nodiscard]] std::byte *slot_data(uint32_t slot) const;
+
+    void open_spill_file();
+};
@@ -18,18 +18,33 @@
 #include "video_encoder.h"
 #include "configuration.h"
 #include "dct_common.h"
+#include "decoder.h"
 
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <span>
 #include <stdexcept>
 
-VideoDecoder::VideoDecoder(const std::string &input_path) {
-    init_decoder(input_path);
+#if defined(__AVX2__) || defined(__SSE2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64)))
+#include <immintrin.h>
+#endif
+
+// Maps |projection| to a confidence byte. A cleanly embedded bit projects to roughly 850, so
+// this leaves plenty of resolution near zero, where the bits worth flipping are.
+static constexpr float SOFT_CONFIDENCE_SCALE = 0.25f;
+
+VideoDecoder::VideoDecoder(const std::string &input_path, const std::size_t read_ahead, const int codec_threads) {
+    init_decoder(input_path, read_ahead, codec_threads);
 }
 
 VideoDecoder::~VideoDecoder() {
+    if (swr_ctx_) swr_free(&swr_ctx_);
+    if (audio_frame_) av_frame_free(&audio_frame_);
+    if (audio_codec_ctx_) avcodec_free_context(&audio_codec_ctx_);
     if (sws_ctx_) sws_freeContext(sws_ctx_);
     if (av_packet_) av_packet_free(&av_packet_);
     if (gray_frame_) av_frame_free(&gray_frame_);
@@ -38,8 +53,19 @@ VideoDecoder::~VideoDecoder() {
     if (format_ctx_) avformat_close_input(&format_ctx_);
 }
 
-void VideoDecoder::init_decoder(const std::string &input_path) {
-    int ret = avformat_open_input(&format_ctx_, input_path.c_str(), nullptr, nullptr);
+void VideoDecoder::init_decoder(const std::string &input_path, const std::size_t read_ahead,
+                                const int codec_threads) {
+    if (StreamInput::is_stream_url(input_path)) {
+        stream_ = std::make_unique<StreamInput>(input_path, read_ahead);
+        format_ctx_ = avformat_alloc_context();
+        if (!format_ctx_) {
+            throw std::runtime_error("Failed to allocate format context");
+        }
+        format_ctx_->pb = stream_->context();
+        format_ctx_->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+
+    int ret = avformat_open_input(&format_ctx_, stream_ ? nullptr : input_path.c_str(), nullptr, nullptr);
     if (ret < 0) {
         throw std::runtime_error("Failed to open input file");
     }
@@ -60,6 +86,16 @@ void VideoDecoder::init_decoder(const std::string &input_path) {
         throw std::runtime_error("No video stream found");
     }
 
+    for (unsigned i = 0; i < format_ctx_->nb_streams; ++i) {
+        const AVStream *candidate = format_ctx_->streams[i];
+        if (candidate->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
+            av_dict_get(candidate->metadata, AUDIO_PACKETS_TAG, nullptr, 0)) {
+            audio_stream_index_ = static_cast<int>(i);
+            init_audio_decoder();
+            break;
+        }
+    }
+
     const AVStream *stream = format_ctx_->streams[video_stream_index_];
     const AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
     if (!codec) {
@@ -76,6 +112,11 @@ void VideoDecoder::init_decoder(const std::string &input_path) {
         throw std::runtime_error("Failed to copy codec parameters");
     }
 
+    // Slice threading only: frame threading would hold frames back and add latency ahead of
+    // extraction, which already runs across all cores.
+    codec_ctx_->thread_count = codec_threads;
+    codec_ctx_->thread_type = FF_THREAD_SLICE;
+
     ret = avcodec_open2(codec_ctx_, codec, nullptr);
     if (ret < 0) {
         throw std::runtime_error("Failed to open codec");
@@ -88,6 +129,7 @@ void VideoDecoder::init_decoder(const std::string &input_path) {
         throw std::runtime_error("Failed to allocate frame/packet");
     }
     is_gray8_ = (codec_ctx_->pix_fmt == AV_PIX_FMT_GRAY8);
+    chroma_size_ = chroma_plane_size(codec_ctx_->pix_fmt, codec_ctx_->width, codec_ctx_->height);
 
     if (!is_gray8_) {
         gray_frame_ = av_frame_alloc();
@@ -115,7 +157,97 @@ void VideoDecoder::init_decoder(const std::string &input_path) {
         }
     }
 
-    layout_ = compute_frame_layout();
+    // The frame size comes from the codec parameters. The embedding is written by VideoEncoder as
+    // a stream tag; a container that lost its tags falls back to probing frames.
+    const int width = codec_ctx_->width;
+    const int height = codec_ctx_->height;
+    layout_ = compute_frame_layout(DEFAULT_BITS_PER_BLOCK, width, height);
+    try {
+        if (const AVDictionaryEntry *tag = av_dict_get(stream->metadata, BITS_PER_PIXEL_TAG, nullptr, 0)) {
+            layout_ = compute_direct_frame_layout(std::atoi(tag->value), width, height);
+            layout_known_ = true;
+        } else if ((tag = av_dict_get(stream->metadata, BITS_PER_BLOCK_TAG, nullptr, 0))) {
+            layout_ = compute_frame_layout(std::atoi(tag->value), width, height);
+            layout_known_ = true;
+        }
+        chroma_tagged_ = chroma_size_.has_value() &&
+                         av_dict_get(stream->metadata, CHROMA_PLANES_TAG, nullptr, 0) != nullptr;
+        if (chroma_tagged_ && layout_known_) {
+            layout_ = with_chroma_planes(layout_, chroma_size_->first, chroma_size_->second);
+        }
+    } catch (const std::runtime_error &) {
+        layout_ = compute_frame_layout(DEFAULT_BITS_PER_BLOCK, width, height);
+        layout_known_ = false;
+        chroma_tagged_ = false;
+    }
+}
+
+void VideoDecoder::init_audio_decoder() {
+    const AVStream *stream = format_ctx_->streams[audio_stream_index_];
+    const AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        throw std::runtime_error("Failed to find audio decoder");
+    }
+
+    audio_codec_ctx_ = avcodec_alloc_context3(codec);
+    if (!audio_codec_ctx_) {
+        throw std::runtime_error("Failed to allocate audio codec context");
+    }
+
+    int ret = avcodec_parameters_to_context(audio_codec_ctx_, stream->codecpar);
+    if (ret < 0) {
+        throw std::runtime_error("Failed to copy audio codec parameters");
+    }
+
+    ret = avcodec_open2(audio_codec_ctx_, codec, nullptr);
+    if (ret < 0) {
+        throw std::runtime_error("Failed to open audio codec");
+    }
+
+    audio_frame_ = av_frame_alloc();
+    if (!audio_frame_) {
+        throw std::runtime_error("Failed to allocate audio frame");
+    }
+}
+
+void VideoDecoder::decode_audio_packet(const AVPacket *packet) {
+    if (avcodec_send_packet(audio_codec_ctx_, packet) < 0) {
+        return;
+    }
+    while (avcodec_receive_frame(audio_codec_ctx_, audio_frame_) >= 0) {
+        append_audio_samples();
+        av_frame_unref(audio_frame_);
+    }
+}
+
+void VideoDecoder::append_audio_samples() {
+    const int channels = audio_frame_->ch_layout.nb_channels;
+    const auto bytes = static_cast<std::size_t>(audio_frame_->nb_samples) * channels * sizeof(int16_t);
+    const std::size_t offset = audio_bytes_.size();
+    audio_bytes_.resize(offset + bytes);
+    auto *out = reinterpret_cast<uint8_t *>(audio_bytes_.data() + offset);
+
+    if (audio_frame_->format == AV_SAMPLE_FMT_S16) {
+        std::memcpy(out, audio_frame_->data[0], bytes);
+        return;
+    }
+
+    // A remux that widened or deinterleaved the samples still holds the same 16-bit values, and
+    // swresample converts them back exactly.
+    if (!swr_ctx_) {
+        if (swr_alloc_set_opts2(&swr_ctx_, &audio_frame_->ch_layout, AV_SAMPLE_FMT_S16, audio_frame_->sample_rate,
+                                &audio_frame_->ch_layout, static_cast<AVSampleFormat>(audio_frame_->format),
+                                audio_frame_->sample_rate, 0, nullptr) < 0 || swr_init(swr_ctx_) < 0) {
+            throw std::runtime_error("Failed to create audio resampler");
+        }
+    }
+    const int converted = swr_convert(swr_ctx_, &out, audio_frame_->nb_samples,
+                                      const_cast<const uint8_t **>(audio_frame_->extended_data),
+                                      audio_frame_->nb_samples);
+    if (converted < 0) {
+        throw std::runtime_error("Failed to convert audio samples");
+    }
+    audio_bytes_.resize(offset + static_cast<std::size_t>(converted) * channels * sizeof(int16_t));
 }
 
 int64_t VideoDecoder::total_frames() const {
@@ -133,65 +265,394 @@ int64_t VideoDecoder::total_frames() const {
     return -1;
 }
 
-std::vector<std::byte> VideoDecoder::extract_data_from_frame() const {
-    const auto &[vectors] = get_decoder_projections();
+namespace {
+    // Floating-point fallback for widths whose block rows end partway through a byte. Projects
+    // `groups` groups of blocks (see blocks_per_group), starting at group `first_group`, onto the
+    // first Bits embed positions. Bits come out most significant first, and `conf`
+    // (if set) gets one confidence byte per bit.
+    template<int Bits>
+    void extract_groups(const uint8_t *src_base, const int src_stride, const int blocks_per_row,
+                        const int first_group, const int groups, uint8_t *out, uint8_t *conf) {
+        constexpr int group_blocks = blocks_per_group(Bits);
+        constexpr int group_bytes = group_blocks * Bits / 8;
+        const auto &[vectors] = get_decoder_projections();
 
-    const int blocks_per_row = layout_.blocks_per_row;
-    const int total_blocks = layout_.total_blocks;
-    constexpr int blocks_per_byte = 8 / BITS_PER_BLOCK;
+#pragma omp parallel for schedule(static) if (groups > 64)
+        for (int group = 0; group < groups; ++group) {
+            uint32_t bits = 0;
 
-    const int total_bytes = total_blocks / blocks_per_byte;
-    const uint8_t *src_base;
-    int src_stride;
-    if (is_gray8_) {
-        src_base = frame_->data[0];
-        src_stride = frame_->linesize[0];
-    } else {
-        src_base = gray_frame_->data[0];
-        src_stride = gray_frame_->linesize[0];
+            for (int sub = 0; sub < group_blocks; ++sub) {
+                const int block_idx = (first_group + group) * group_blocks + sub;
+                const int block_row = block_idx / blocks_per_row;
+                const int block_col = block_idx % blocks_per_row;
+                const int base_x = block_col * 8;
+                const int base_y = block_row * 8;
+
+                alignas(32) float block_flat[64];
+                for (int y = 0; y < 8; ++y) {
+                    const uint8_t *row = src_base + (base_y + y) * src_stride + base_x;
+                    for (int x = 0; x < 8; ++x)
+                        block_flat[y * 8 + x] = static_cast<float>(row[x]);
+                }
+
+                for (int b = 0; b < Bits; ++b) {
+                    const float sum = dot_product_64(block_flat, vectors[b]);
+                    bits = (bits << 1) | (sum > 0.0f ? 1u : 0u);
+                    if (conf) {
+                        conf[(group * group_blocks + sub) * Bits + b] = static_cast<uint8_t>(
+                            std::min(255.0f, std::abs(sum) * SOFT_CONFIDENCE_SCALE));
+                    }
+                }
+            }
+
+            for (int i = 0; i < group_bytes; ++i) {
+                out[group * group_bytes + i] = static_cast<uint8_t>(bits >> (8 * (group_bytes - 1 - i)));
+            }
+        }
     }
 
-    std::vector data(total_bytes, std::byte{0});
-    auto *out = reinterpret_cast<uint8_t *>(data.data());
+    static_assert(EMBED_POSITIONS[0] == std::pair{0, 1} && EMBED_POSITIONS[1] == std::pair{1, 0} &&
+                  EMBED_POSITIONS[2] == std::pair{1, 1} && EMBED_POSITIONS[3] == std::pair{0, 2},
+                  "project_band hard-codes the embed positions");
 
-#pragma omp parallel for schedule(static)
-    for (int byte_idx = 0; byte_idx < total_bytes; ++byte_idx) {
-        uint8_t current_byte = 0;
+    // Units of the integer projections: (1, 1) is weighted on both axes, the others on one.
+    constexpr float PROJECTION_UNIT[MAX_BITS_PER_BLOCK] = {
+        1.0f / PROJECTION_WEIGHT_SCALE,
+        1.0f / PROJECTION_WEIGHT_SCALE,
+        1.0f / (PROJECTION_WEIGHT_SCALE * PROJECTION_WEIGHT_SCALE),
+        1.0f / PROJECTION_WEIGHT_SCALE,
+    };
 
-        for (int sub = 0; sub < blocks_per_byte; ++sub) {
-            const int block_idx = byte_idx * blocks_per_byte + sub;
-            const int block_row = block_idx / blocks_per_row;
-            const int block_col = block_idx % blocks_per_row;
-            const int base_x = block_col * 8;
-            const int base_y = block_row * 8;
+    // Integer projections of one block onto the first Bits embed positions.
+    template<int Bits>
+    void project_block(const uint8_t *src, const int src_stride, const IntegerProjections &weights,
+                       int32_t *sums) {
+        int32_t acc[MAX_BITS_PER_BLOCK]{};
+#if defined(DCT_USE_NEON)
+        const int16x8_t cos1 = vmovl_s8(vld1_s8(weights.cos1));
+        const int16x8_t cos2 = vmovl_s8(vld1_s8(weights.cos2));
+#endif
+        for (int y = 0; y < 8; ++y) {
+            const uint8_t *row = src + static_cast<std::ptrdiff_t>(y) * src_stride;
+            int32_t h0 = 0;
+            int32_t h1 = 0;
+            int32_t h2 = 0;
+#if defined(DCT_USE_NEON)
+            const uint8x8_t pixels = vld1_u8(row);
+            const int16x8_t wide = vreinterpretq_s16_u16(vmovl_u8(pixels));
+            h0 = vaddlv_u8(pixels);
+            h1 = vaddvq_s32(vmlal_s16(vmull_s16(vget_low_s16(wide), vget_low_s16(cos1)),
+                                      vget_high_s16(wide), vget_high_s16(cos1)));
+            if constexpr (Bits >= 4) {
+                h2 = vaddvq_s32(vmlal_s16(vmull_s16(vget_low_s16(wide), vget_low_s16(cos2)),
+                                          vget_high_s16(wide), vget_high_s16(cos2)));
+            }
+#else
+            for (int x = 0; x < 8; ++x) {
+                h0 += row[x];
+                h1 += weights.cos1[x] * row[x];
+                h2 += weights.cos2[x] * row[x];
+            }
+#endif
+            acc[0] += h1;
+            acc[1] += weights.cos1[y] * h0;
+            acc[2] += weights.cos1[y] * h1;
+            acc[3] += h2;
+        }
+        for (int b = 0; b < Bits; ++b) {
+            sums[b] = acc[b];
+        }
+    }
 
-            alignas(32) float block_flat[64];
+    // Integer projections of `count` consecutive blocks of one band (a row of blocks). The
+    // basis is separable, so every pixel row is dotted with the column weights once (pmaddubsw
+    // and pmaddwd, or psadbw for a plain sum) and the row weights are applied to those results,
+    // four blocks per 256-bit vector.
+    template<int Bits>
+    void project_band(const uint8_t *band, const int src_stride, const int count, const IntegerProjections &weights,
+                      int32_t (*sums)[MAX_BITS_PER_BLOCK]) {
+        int block = 0;
+#if defined(__AVX2__)
+        int64_t cos1_bytes = 0;
+        int64_t cos2_bytes = 0;
+        std::memcpy(&cos1_bytes, weights.cos1, sizeof(cos1_bytes));
+        std::memcpy(&cos2_bytes, weights.cos2, sizeof(cos2_bytes));
+        const __m256i cos1 = _mm256_set1_epi64x(cos1_bytes);
+        const __m256i cos2 = _mm256_set1_epi64x(cos2_bytes);
+        const __m256i ones = _mm256_set1_epi16(1);
+        const __m256i zero = _mm256_setzero_si256();
+        for (; block + 4 <= count; block += 4) {
+            __m256i acc[MAX_BITS_PER_BLOCK] = {zero, zero, zero, zero};
             for (int y = 0; y < 8; ++y) {
-                const uint8_t *row = src_base + (base_y + y) * src_stride + base_x;
-                for (int x = 0; x < 8; ++x)
-                    block_flat[y * 8 + x] = static_cast<float>(row[x]);
+                const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(
+                    band + static_cast<std::ptrdiff_t>(y) * src_stride + block * 8));
+                const __m256i row_weight = _mm256_set1_epi32(weights.cos1[y]);
+                // Each block row lands in two 32-bit lanes, summed once the band is done.
+                const __m256i h1 = _mm256_madd_epi16(_mm256_maddubs_epi16(pixels, cos1), ones);
+                acc[0] = _mm256_add_epi32(acc[0], h1);
+                if constexpr (Bits >= 2) {
+                    const __m256i h0 = _mm256_sad_epu8(pixels, zero);
+                    acc[1] = _mm256_add_epi32(acc[1], _mm256_mullo_epi32(h0, row_weight));
+                }
+                if constexpr (Bits >= 3) {
+                    acc[2] = _mm256_add_epi32(acc[2], _mm256_mullo_epi32(h1, row_weight));
+                }
+                if constexpr (Bits >= 4) {
+                    acc[3] = _mm256_add_epi32(acc[3], _mm256_madd_epi16(_mm256_maddubs_epi16(pixels, cos2), ones));
+                }
+            }
+            for (int b = 0; b < Bits; ++b) {
+                alignas(32) int32_t lanes[8];
+                _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), acc[b]);
+                for (int i = 0; i < 4; ++i) {
+                    sums[block + i][b] = lanes[2 * i] + lanes[2 * i + 1];
+                }
             }
+        }
+#endif
+        for (; block < count; ++block) {
+            project_block<Bits>(band + block * 8, src_stride, weights, sums[block]);
+        }
+    }
 
-            for (int b = 0; b < BITS_PER_BLOCK; ++b) {
-                const float sum = dot_product_64(block_flat, vectors[b]);
-                current_byte = (current_byte << 1) | (sum > 0.0f ? 1 : 0);
+    // Extracts the first `blocks` blocks band by band with the integer kernel. Every band has
+    // to start on a byte, so blocks_per_row * Bits must be a multiple of 8.
+    template<int Bits>
+    void extract_bands(const uint8_t *src_base, const int src_stride, const int blocks_per_row, const int blocks,
+                       uint8_t *out, uint8_t *conf) {
+        const auto &weights = get_integer_projections();
+        const int bands = (blocks + blocks_per_row - 1) / blocks_per_row;
+
+#pragma omp parallel for schedule(static) if (bands > 1)
+        for (int band = 0; band < bands; ++band) {
+            const int first = band * blocks_per_row;
+            const int count = std::min(blocks_per_row, blocks - first);
+            int32_t sums[MAX_FRAME_DIMENSION / 8][MAX_BITS_PER_BLOCK];
+            project_band<Bits>(src_base + static_cast<std::ptrdiff_t>(band) * 8 * src_stride, src_stride, count,
+                               weights, sums);
+
+            uint8_t *band_out = out + first * Bits / 8;
+            uint32_t byte = 0;
+            int filled = 0;
+            for (int i = 0; i < count; ++i) {
+                for (int b = 0; b < Bits; ++b) {
+                    byte = (byte << 1) | (sums[i][b] > 0 ? 1u : 0u);
+                    if (++filled == 8) {
+                        *band_out++ = static_cast<uint8_t>(byte);
+                        byte = 0;
+                        filled = 0;
+                    }
+                    if (conf) {
+                        const float sum = static_cast<float>(std::abs(sums[i][b])) * PROJECTION_UNIT[b];
+                        conf[(first + i) * Bits + b] = static_cast<uint8_t>(
+                            std::min(255.0f, sum * SOFT_CONFIDENCE_SCALE));
+                    }
+                }
             }
         }
+    }
+
+    void extract_groups(const int bits_per_block, const uint8_t *src_base, const int src_stride,
+                        const int blocks_per_row, const int first_group, const int groups, uint8_t *out,
+                        uint8_t *conf) {
+        switch (bits_per_block) {
+            case 1:
+                extract_groups<1>(src_base, src_stride, blocks_per_row, first_group, groups, out, conf);
+                break;
+            case 2:
+                extract_groups<2>(src_base, src_stride, blocks_per_row, first_group, groups, out, conf);
+                break;
+            case 3:
+                extract_groups<3>(src_base, src_stride, blocks_per_row, first_group, groups, out, conf);
+                break;
+            default:
+                extract_groups<4>(src_base, src_stride, blocks_per_row, first_group, groups, out, conf);
+                break;
+        }
+    }
+}
+
+namespace {
+    // Direct mode: reads `bytes` bytes stored Bits per pixel in raster order, snapping each pixel
+    // to the nearest of the 2^Bits levels. Confidence is the distance to the decision boundary;
+    // at 8 bits there is no margin to measure.
+    template<int Bits>
+    void extract_pixels(const uint8_t *src_base, const int src_stride, const int width, const int bytes,
+                        uint8_t *out, uint8_t *conf) {
+        constexpr int pixels_per_byte = 8 / Bits;
+        constexpr int max_symbol = (1 << Bits) - 1;
+        constexpr float half_step = 127.5f / static_cast<float>(max_symbol);
+        const int row_bytes = width / pixels_per_byte;
+        const int rows = (bytes + row_bytes - 1) / row_bytes;
+
+#pragma omp parallel for schedule(static) if (rows > 16)
+        for (int y = 0; y < rows; ++y) {
+            const uint8_t *row = src_base + static_cast<std::ptrdiff_t>(y) * src_stride;
+            const int first = y * row_bytes;
+            const int count = std::min(row_bytes, bytes - first);
+            if constexpr (Bits == 8) {
+                std::memcpy(out + first, row, count);
+                if (conf) {
+                    std::memset(conf + static_cast<std::size_t>(first) * 8, 255, static_cast<std::size_t>(count) * 8);
+                }
+            } else {
+                for (int i = 0; i < count; ++i) {
+                    uint8_t value = 0;
+                    for (int sub = 0; sub < pixels_per_byte; ++sub) {
+                        const int pixel = row[i * pixels_per_byte + sub];
+                        const int symbol = (pixel * max_symbol + 127) / 255;
+                        value = static_cast<uint8_t>((value << Bits) | symbol);
+                        if (conf) {
+                            const float level = static_cast<float>(symbol) * 2.0f * half_step;
+                            const float margin = half_step - std::abs(static_cast<float>(pixel) - level);
+                            const auto c = static_cast<uint8_t>(std::clamp(margin / half_step * 255.0f, 0.0f, 255.0f));
+                            std::memset(conf + (static_cast<std::size_t>(first + i) * 8 + sub * Bits), c, Bits);
+                        }
+                    }
+                    out[first + i] = value;
+                }
+            }
+        }
+    }
+
+    void extract_pixels(int bits_per_pixel, const uint8_t *src_base, int src_stride, int width, int bytes,
+                        uint8_t *out, uint8_t *conf);
+
+    // Reads the first `bytes` bytes of one plane embedded with `plane`.
+    void extract_plane(const FrameLayout &plane, const uint8_t *src_base, const int src_stride, uint8_t *out,
+                       const int bytes, uint8_t *conf) {
+        if (plane.bits_per_pixel != 0) {
+            extract_pixels(plane.bits_per_pixel, src_base, src_stride, plane.frame_width, bytes, out, conf);
+            return;
+        }
+        const int group_blocks = blocks_per_group(plane.bits_per_block);
+        const int group_bytes = group_blocks * plane.bits_per_block / 8;
+        const int groups = std::min(plane.total_blocks / group_blocks, (bytes + group_bytes - 1) / group_bytes);
+        const int blocks = groups * group_blocks;
+        if (plane.blocks_per_row * plane.bits_per_block % 8 != 0) {
+            extract_groups(plane.bits_per_block, src_base, src_stride, plane.blocks_per_row, 0, groups, out, conf);
+            return;
+        }
+        switch (plane.bits_per_block) {
+            case 1:
+                extract_bands<1>(src_base, src_stride, plane.blocks_per_row, blocks, out, conf);
+                break;
+            case 2:
+                extract_bands<2>(src_base, src_stride, plane.blocks_per_row, blocks, out, conf);
+                break;
+            case 3:
+                extract_bands<3>(src_base, src_stride, plane.blocks_per_row, blocks, out, conf);
+                break;
+            default:
+                extract_bands<4>(src_base, src_stride, plane.blocks_per_row, blocks, out, conf);
+                break;
+        }
+    }
+
+    void extract_pixels(const int bits_per_pixel, const uint8_t *src_base, const int src_stride, const int width,
+                        const int bytes, uint8_t *out, uint8_t *conf) {
+        switch (bits_per_pixel) {
+            case 1:
+                extract_pixels<1>(src_base, src_stride, width, bytes, out, conf);
+                break;
+            case 2:
+                extract_pixels<2>(src_base, src_stride, width, bytes, out, conf);
+                break;
+            case 4:
+                extract_pixels<4>(src_base, src_stride, width, bytes, out, conf);
+                break;
+            default:
+                extract_pixels<8>(src_base, src_stride, width, bytes, out, conf);
+                break;
+        }
+    }
+}
 
-        out[byte_idx] = current_byte;
+std::pair<const uint8_t *, int> VideoDecoder::gray_plane() const {
+    const AVFrame *plane = is_gray8_ ? frame_ : gray_frame_;
+    return {plane->data[0], plane->linesize[0]};
+}
+
+void VideoDecoder::extract_data_from_frame(const std::span<std::byte> out_bytes,
+                                           const std::span<uint8_t> confidence) const {
+    extract_with_layout(layout_, reinterpret_cast<uint8_t *>(out_bytes.data()), layout_.bytes_per_frame,
+                        confidence.empty() ? nullptr : confidence.data());
+}
+
+void VideoDecoder::extract_with_layout(const FrameLayout &layout, uint8_t *out, int bytes, uint8_t *conf) const {
+    if (layout.chroma_width == 0) {
+        const auto [src_base, src_stride] = gray_plane();
+        extract_plane(layout, src_base, src_stride, out, bytes, conf);
+        return;
+    }
+    // Chroma mode embeds straight into the YUV planes, so all three are read as decoded.
+    for (int p = 0; p < 3 && bytes > 0; ++p) {
+        const FrameLayout plane = plane_layout(layout, p);
+        const int count = std::min(bytes, plane.bytes_per_frame);
+        extract_plane(plane, frame_->data[p], frame_->linesize[p], out, count, conf);
+        out += count;
+        bytes -= count;
+        if (conf) {
+            conf += static_cast<std::size_t>(count) * 8;
+        }
     }
+}
 
-    return data;
+bool VideoDecoder::chroma_planes_active() const {
+    // A gray frame converted to YUV has flat chroma at 128; embedded blocks or pixels swing far
+    // from it. The top block row of U is enough to tell.
+    const auto [width, height] = *chroma_size_;
+    const int rows = std::min(8, height);
+    int64_t deviation = 0;
+    for (int y = 0; y < rows; ++y) {
+        const uint8_t *row = frame_->data[1] + static_cast<std::ptrdiff_t>(y) * frame_->linesize[1];
+        for (int x = 0; x < width; ++x) {
+            deviation += std::abs(row[x] - 128);
+        }
+    }
+    return deviation > 4 * static_cast<int64_t>(rows) * width;
 }
 
-std::size_t get_packet_size(const std::span<const std::byte> data) {
-    if (data.size() < 5) {
-        return HEADER_SIZE + SYMBOL_SIZE_BYTES;
+bool VideoDecoder::detect_layout() {
+    // Every frame starts with a packet, so the layout that reads a magic and a known version at
+    // the top of the frame is the one it was embedded with.
+    const int width = layout_.frame_width;
+    const int height = layout_.frame_height;
+    std::vector<FrameLayout> candidates;
+    for (int bits = 1; bits <= MAX_BITS_PER_BLOCK; ++bits) {
+        candidates.push_back(compute_frame_layout(bits, width, height));
+    }
+    for (const int bits: {8, 4, 2, 1}) {
+        candidates.push_back(compute_direct_frame_layout(bits, width, height));
+    }
+    if (chroma_size_ && (chroma_tagged_ || chroma_planes_active())) {
+        const auto [chroma_width, chroma_height] = *chroma_size_;
+        if (chroma_width % 8 == 0 && chroma_height % 8 == 0) {
+            for (auto &candidate: candidates) {
+                candidate = with_chroma_planes(candidate, chroma_width, chroma_height);
+            }
+        }
+    }
+
+    for (const auto &candidate: candidates) {
+        // Room for whole groups past the header bytes; a DCT group is at most 3 bytes.
+        std::array<uint8_t, MAGIC_SIZE + VERSION_SIZE + 3> head{};
+        extract_with_layout(candidate, head.data(), MAGIC_SIZE + VERSION_SIZE, nullptr);
+
+        uint32_t magic = 0;
+        std::memcpy(&magic, head.data(), sizeof(magic));
+        if (const uint8_t version = head[VERSION_OFF];
+            magic == MAGIC_ID && (version == VERSION_ID || version == VERSION_ID_V2)) {
+            layout_ = candidate;
+            layout_known_ = true;
+            return true;
+        }
     }
-    const uint8_t version = static_cast<uint8_t>(data[4]);
-    return (version == VERSION_ID_V2)
-               ? (HEADER_SIZE_V2 + SYMBOL_SIZE_BYTES)
-               : (HEADER_SIZE + SYMBOL_SIZE_BYTES);
+    return false;
+}
+
+static std::size_t packet_size_for(const uint8_t version) {
+    return (version == VERSION_ID_V2 ? HEADER_SIZE_V2 : HEADER_SIZE) + SYMBOL_SIZE_BYTES;
 }
 
 namespace {
@@ -201,100 +662,312 @@ namespace {
         static_cast<std::byte>(MAGIC_ID >> 16),
         static_cast<std::byte>(MAGIC_ID >> 24),
     };
-}
 
-void VideoDecoder::extract_packets_from_buffer(std::vector<std::byte> &accumulated,
-                                               std::vector<std::vector<std::byte> > &out_packets) {
-    std::size_t offset = 0;
-    while (offset + 4 <= accumulated.size()) {
-        auto it = std::search(accumulated.begin() + static_cast<std::ptrdiff_t>(offset),
-                              accumulated.end(),
-                              MAGIC_BYTES.begin(), MAGIC_BYTES.end());
-        if (it == accumulated.end()) {
-            break;
+    bool magic_at(const std::span<const std::byte> data, const std::size_t offset) {
+        return offset + MAGIC_BYTES.size() <= data.size() &&
+               std::memcmp(data.data() + offset, MAGIC_BYTES.data(), MAGIC_BYTES.size()) == 0;
+    }
+
+    // Position of the first magic at or after `offset`, or data.size(). Candidates are found by
+    // matching the first two magic bytes a whole vector at a time, then checked in full.
+    std::size_t find_magic(const std::span<const std::byte> data, std::size_t offset) {
+        const auto *bytes = reinterpret_cast<const uint8_t *>(data.data());
+        const std::size_t size = data.size();
+#if defined(__AVX2__)
+        const __m256i first = _mm256_set1_epi8(static_cast<char>(MAGIC_BYTES[0]));
+        const __m256i second = _mm256_set1_epi8(static_cast<char>(MAGIC_BYTES[1]));
+        for (; offset + 33 <= size; offset += 32) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + offset));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + offset + 1));
+            auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, second))));
+            while (mask != 0) {
+                const std::size_t candidate = offset + static_cast<std::size_t>(std::countr_zero(mask));
+                if (magic_at(data, candidate)) {
+                    return candidate;
+                }
+                mask &= mask - 1;
+            }
         }
-        offset = static_cast<std::size_t>(std::distance(accumulated.begin(), it));
-        const std::size_t packet_size = get_packet_size(
-            std::span<const std::byte>(accumulated.data() + offset,
-                                       accumulated.size() - offset));
-        if (offset + packet_size > accumulated.size()) {
-            break;
+#elif defined(__SSE2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64)))
+        const __m128i first = _mm_set1_epi8(static_cast<char>(MAGIC_BYTES[0]));
+        const __m128i second = _mm_set1_epi8(static_cast<char>(MAGIC_BYTES[1]));
+        for (; offset + 17 <= size; offset += 16) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + offset));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + offset + 1));
+            auto mask = static_cast<uint32_t>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, second))));
+            while (mask != 0) {
+                const std::size_t candidate = offset + static_cast<std::size_t>(std::countr_zero(mask));
+                if (magic_at(data, candidate)) {
+                    return candidate;
+                }
+                mask &= mask - 1;
+            }
         }
-        std::vector<std::byte> packet(
-            accumulated.begin() + static_cast<std::ptrdiff_t>(offset),
-            accumulated.begin() + static_cast<std::ptrdiff_t>(offset + packet_size));
-        out_packets.push_back(std::move(packet));
-        offset += packet_size;
+#endif
+        while (offset + MAGIC_BYTES.size() <= size) {
+            const auto *hit = static_cast<const uint8_t *>(
+                std::memchr(bytes + offset, static_cast<int>(MAGIC_BYTES[0]), size - MAGIC_BYTES.size() + 1 - offset));
+            if (!hit) {
+                break;
+            }
+            offset = static_cast<std::size_t>(hit - bytes);
+            if (magic_at(data, offset)) {
+                return offset;
+            }
+            ++offset;
+        }
+        return size;
+    }
+}
+
+void VideoDecoder::count_pilot_errors(const std::span<const std::byte> packet_start) {
+    // The magic and version bytes are known in advance, so every packet start doubles as a pilot.
+    for (std::size_t i = 0; i < MAGIC_BYTES.size(); ++i) {
+        frame_stats_.pilot_bit_errors += std::popcount(static_cast<uint8_t>(packet_start[i] ^ MAGIC_BYTES[i]));
     }
-    accumulated.erase(accumulated.begin(),
-                      accumulated.begin() + static_cast<std::ptrdiff_t>(offset));
+    frame_stats_.pilot_bit_errors += std::popcount(
+        static_cast<uint8_t>(static_cast<uint8_t>(packet_start[VERSION_OFF]) ^ pilot_version_));
+    frame_stats_.pilot_bits += (MAGIC_SIZE + VERSION_SIZE) * 8;
 }
 
-std::vector<std::vector<std::byte> > VideoDecoder::extract_packets_from_frame() const {
-    const auto raw_data = extract_data_from_frame();
-    std::vector<std::vector<std::byte> > packets;
-    const std::size_t packet_size = get_packet_size(std::span(raw_data));
-    packets.reserve(raw_data.size() / packet_size);
+void VideoDecoder::scan_slab_for_packets(const std::size_t frame_start) {
+    packet_views_.clear();
+    frame_stats_ = {};
+    const std::span<const std::byte> data(*slab_);
     std::size_t offset = 0;
-    while (offset + packet_size <= raw_data.size()) {
-        if (offset + 4 <= raw_data.size()) {
-            uint32_t magic = 0;
-            std::memcpy(&magic, raw_data.data() + offset, sizeof(magic));
-            if (magic != MAGIC_ID) {
-                break;
+    // The encoder writes packets back to back from the start of each frame, so this is where
+    // the next one belongs on a clean channel.
+    std::size_t expected = frame_start;
+    while (offset + MAGIC_BYTES.size() <= data.size()) {
+        // Clean frames never leave the fixed stride, so the search only runs after corruption
+        // and over the padding at the end of each frame.
+        const std::size_t next = offset == expected && magic_at(data, offset) ? offset : find_magic(data, offset);
+
+        const std::size_t stride = packet_size_for(pilot_version_);
+        // With no magic left in the slab the remaining slots are the gray filler the encoder pads
+        // the final frame with, not damaged packets, so they are neither counted nor repaired.
+        const bool found = next < data.size();
+        std::size_t bad_slots = 0;
+        for (std::size_t slot = expected; next >= expected && slot <= next && slot + stride <= data.size();
+             slot += stride) {
+            if (found) {
+                count_pilot_errors(data.subspan(slot));
+            }
+            if (slot != next) {
+                ++bad_slots;
+                if (soft_repair_ && found && slot + stride <= next) {
+                    // The pilots are known, so put them back and leave the rest to soft repair.
+                    std::ranges::copy(MAGIC_BYTES, slab_->begin() + static_cast<std::ptrdiff_t>(slot));
+                    (*slab_)[slot + VERSION_OFF] = std::byte{pilot_version_};
+                    packet_views_.push_back(data.subspan(slot, stride));
+                }
             }
         }
-        std::vector<std::byte> packet(
-            raw_data.begin() + static_cast<std::ptrdiff_t>(offset),
-            raw_data.begin() + static_cast<std::ptrdiff_t>(offset + packet_size));
-        packets.push_back(std::move(packet));
+        if (found && bad_slots > 0) {
+            frame_stats_.bad_magic += bad_slots;
+            ++frame_stats_.resyncs;
+            frame_stats_.bytes_discarded += next - expected;
+        }
+
+        if (next == data.size()) {
+            // Keep the last few bytes in case the magic straddles the frame boundary.
+            offset = data.size() - (MAGIC_BYTES.size() - 1);
+            break;
+        }
+        offset = next;
+        if (offset + VERSION_OFF >= data.size()) {
+            break;
+        }
+        if (const auto version = static_cast<uint8_t>(data[offset + VERSION_OFF]);
+            version == VERSION_ID || version == VERSION_ID_V2) {
+            pilot_version_ = version;
+        } else if (soft_repair_) {
+            (*slab_)[offset + VERSION_OFF] = std::byte{pilot_version_};
+        }
+        // A damaged version byte would otherwise throw the framing off by the header size difference.
+        const std::size_t packet_size = packet_size_for(pilot_version_);
+        if (offset + packet_size > data.size()) {
+            break;
+        }
+        packet_views_.push_back(data.subspan(offset, packet_size));
         offset += packet_size;
+        expected = offset;
     }
-    return packets;
+    slab_consumed_ = offset;
 }
 
 void VideoDecoder::prepare_frame_for_extraction() {
-    if (!is_gray8_) {
+    // Chroma mode reads the decoded planes directly and never needs the gray conversion.
+    if (!is_gray8_ && (!layout_known_ || layout_.chroma_width == 0)) {
         sws_scale(sws_ctx_, frame_->data, frame_->linesize, 0, frame_->height,
                   gray_frame_->data, gray_frame_->linesize);
     }
     ++frame_index_;
+
+    const AVStream *stream = format_ctx_->streams[video_stream_index_];
+    const int64_t ts = frame_->best_effort_timestamp;
+    current_frame_ = (ts == AV_NOPTS_VALUE)
+                         ? -1
+                         : av_rescale_q(ts - (stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time),
+                                        stream->time_base, AVRational{1, FRAME_FPS});
 }
 
-std::vector<std::vector<std::byte> > VideoDecoder::accumulate_frame_and_extract_packets() {
-    const auto raw_data = extract_data_from_frame();
-    extract_buffer_.insert(extract_buffer_.end(), raw_data.begin(), raw_data.end());
-    std::vector<std::vector<std::byte> > packets;
-    packets.reserve(extract_buffer_.size() / (HEADER_SIZE_V2 + SYMBOL_SIZE_BYTES));
-    extract_packets_from_buffer(extract_buffer_, packets);
+std::size_t VideoDecoder::packets_per_frame(const std::size_t packet_size) const {
+    if (packet_size == 0) {
+        return 0;
+    }
+    std::size_t packets = static_cast<std::size_t>(layout_.bytes_per_frame) / packet_size;
+    if (audio_codec_ctx_) {
+        // The encoder fills a frame's audio right after its pixels, so both count towards the stride.
+        const auto audio_bytes = static_cast<std::size_t>(audio_codec_ctx_->sample_rate / FRAME_FPS) *
+                                 audio_codec_ctx_->ch_layout.nb_channels * sizeof(int16_t);
+        packets += audio_bytes / packet_size;
+    }
     return packets;
 }
 
-std::vector<std::vector<std::byte> > VideoDecoder::flush_decoder_and_collect_packets() {
-    avcodec_send_packet(codec_ctx_, nullptr);
-    std::vector<std::vector<std::byte> > collected;
-    while (true) {
-        const int ret = avcodec_receive_frame(codec_ctx_, frame_);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
+bool VideoDecoder::seek_to_frame(const int64_t frame) {
+    if (eof_ || draining_ || stream_) {
+        return false;
+    }
+    const AVStream *stream = format_ctx_->streams[video_stream_index_];
+    int64_t ts = av_rescale_q(frame, AVRational{1, FRAME_FPS}, stream->time_base);
+    if (stream->start_time != AV_NOPTS_VALUE) {
+        ts += stream->start_time;
+    }
+    if (av_seek_frame(format_ctx_, video_stream_index_, ts, AVSEEK_FLAG_BACKWARD) < 0) {
+        return false;
+    }
+    avcodec_flush_buffers(codec_ctx_);
+    if (audio_codec_ctx_) {
+        avcodec_flush_buffers(audio_codec_ctx_);
+    }
+
+    // Packets never straddle frames, so nothing carried over is worth keeping.
+    detach_slab(0);
+    slab_->clear();
+    confidence_.clear();
+    slab_consumed_ = 0;
+    audio_bytes_.clear();
+    audio_consumed_ = 0;
+    return true;
+}
+
+void VideoDecoder::repair_failed_packets() {
+    const auto count = static_cast<int>(packet_views_.size());
+    std::size_t repaired = 0;
+
+#pragma omp parallel for schedule(dynamic, 16) reduction(+ : repaired)
+    for (int i = 0; i < count; ++i) {
+        const PacketView view = packet_views_[i];
+        if (Decoder::validate_raw_packet_crc(view)) {
+            continue;
         }
-        if (ret < 0) {
-            throw std::runtime_error("Error receiving frame");
+        const auto offset = static_cast<std::size_t>(view.data() - slab_->data());
+        if (Decoder::chase_repair(std::span(*slab_).subspan(offset, view.size()),
+                                  std::span<const uint8_t>(confidence_).subspan(offset * 8, view.size() * 8),
+                                  SOFT_REPAIR_CANDIDATE_BITS, SOFT_REPAIR_MAX_PATTERNS)) {
+            ++repaired;
         }
-        prepare_frame_for_extraction();
-        for (auto packets = accumulate_frame_and_extract_packets(); auto &p: packets) {
-            collected.push_back(std::move(p));
+    }
+
+    frame_stats_.soft_repaired = repaired;
+    packets_repaired_ += repaired;
+}
+
+bool VideoDecoder::detach_slab(const std::size_t carried) {
+    if (slab_.use_count() == 1) {
+        return false;
+    }
+    // Someone still reads the previous frame's packets out of this slab, so move on to one that
+    // nobody holds, taking only the unfinished packet along.
+    std::shared_ptr<std::vector<std::byte> > next;
+    if (const auto spare = std::ranges::find_if(spare_slabs_, [](const auto &slab) { return slab.use_count() == 1; });
+        spare != spare_slabs_.end()) {
+        next = std::move(*spare);
+        spare_slabs_.erase(spare);
+    } else {
+        next = std::make_shared<std::vector<std::byte> >();
+    }
+    next->assign(slab_->end() - static_cast<std::ptrdiff_t>(carried), slab_->end());
+    spare_slabs_.push_back(std::exchange(slab_, std::move(next)));
+    return true;
+}
+
+void VideoDecoder::extract_frame_packets() {
+    // Move the unfinished packet from the previous frame to the front, then extract the new
+    // frame right behind it. Slabs keep their capacity, so steady state never allocates.
+    const std::size_t carried = slab_->size() - slab_consumed_;
+    const bool shifted = carried > 0 && slab_consumed_ > 0;
+    if (!detach_slab(carried) && shifted) {
+        std::memmove(slab_->data(), slab_->data() + slab_consumed_, carried);
+    }
+    if (soft_repair_ && shifted) {
+        std::memmove(confidence_.data(), confidence_.data() + slab_consumed_ * 8, carried * 8);
+    }
+    // Until the layout is known from the stream tag or a frame that probed cleanly, frames are
+    // read with the default one.
+    if (!layout_known_) {
+        detect_layout();
+    }
+    const auto frame_bytes = static_cast<std::size_t>(layout_.bytes_per_frame);
+    slab_->resize(carried + frame_bytes);
+    slab_consumed_ = 0;
+
+    std::span<uint8_t> confidence;
+    if (soft_repair_) {
+        confidence_.resize(slab_->size() * 8);
+        confidence = std::span(confidence_).subspan(carried * 8);
+    }
+    extract_data_from_frame(std::span(*slab_).subspan(carried), confidence);
+    scan_slab_for_packets(carried);
+    // 8-bit direct pixels carry no margin, so there are no weak bits for repair to flip.
+    if (soft_repair_ && layout_.bits_per_pixel != 8) {
+        repair_failed_packets();
+    }
+}
+
+void VideoDecoder::collect_audio_packets() {
+    // Each audio frame holds whole packets back to back, then silence up to the next frame, so
+    // the scan just hops from magic to magic. An unfinished packet waits for more samples.
+    const std::span<const std::byte> data(audio_bytes_);
+    std::size_t offset = find_magic(data, audio_consumed_);
+    while (offset + VERSION_OFF < data.size()) {
+        const auto version = static_cast<uint8_t>(data[offset + VERSION_OFF]);
+        if (version != VERSION_ID && version != VERSION_ID_V2) {
+            offset = find_magic(data, offset + 1);
+            continue;
+        }
+        const std::size_t size = packet_size_for(version);
+        if (offset + size > data.size()) {
+            break;
         }
+        packet_views_.push_back(data.subspan(offset, size));
+        ++frame_stats_.audio_packets;
+        offset = find_magic(data, offset + size);
     }
-    return collected;
+    audio_consumed_ = std::min(offset, data.size());
 }
 
-std::vector<std::vector<std::byte> > VideoDecoder::decode_next_frame() {
+const std::vector<VideoDecoder::PacketView> &VideoDecoder::decode_next_frame() {
+    packet_views_.clear();
+    frame_stats_ = {};
+    if (audio_consumed_ > 0) {
+        audio_bytes_.erase(audio_bytes_.begin(), audio_bytes_.begin() + static_cast<std::ptrdiff_t>(audio_consumed_));
+        audio_consumed_ = 0;
+    }
     if (eof_) {
-        return {};
+        return packet_views_;
     }
 
-    while (av_read_frame(format_ctx_, av_packet_) >= 0) {
+    while (!draining_ && av_read_frame(format_ctx_, av_packet_) >= 0) {
+        if (av_packet_->stream_index == audio_stream_index_) {
+            decode_audio_packet(av_packet_);
+            av_packet_unref(av_packet_);
+            continue;
+        }
         if (av_packet_->stream_index != video_stream_index_) {
             av_packet_unref(av_packet_);
             continue;
@@ -312,33 +985,47 @@ std::vector<std::vector<std::byte> > VideoDecoder::decode_next_frame() {
         }
         if (recv_ret == AVERROR_EOF) {
             eof_ = true;
-            return {};
+            collect_audio_packets();
+            return packet_views_;
         }
         if (recv_ret < 0) {
             throw std::runtime_error("Error receiving frame");
         }
 
         prepare_frame_for_extraction();
-        return accumulate_frame_and_extract_packets();
+        extract_frame_packets();
+        collect_audio_packets();
+        return packet_views_;
     }
 
-    eof_ = true;
-    if (auto flushed = flush_decoder_and_collect_packets(); !flushed.empty()) {
-        return flushed;
+    // Drain frames still buffered in the codec, one per call so each keeps the slab to itself.
+    if (!draining_) {
+        avcodec_send_packet(codec_ctx_, nullptr);
+        if (audio_codec_ctx_) {
+            decode_audio_packet(nullptr);
+        }
+        draining_ = true;
     }
-    if (!extract_buffer_.empty()) {
-        std::vector<std::vector<std::byte> > packets;
-        extract_packets_from_buffer(extract_buffer_, packets);
-        return packets;
+    const int ret = avcodec_receive_frame(codec_ctx_, frame_);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+        eof_ = true;
+        collect_audio_packets();
+        return packet_views_;
+    }
+    if (ret < 0) {
+        throw std::runtime_error("Error receiving frame");
     }
-    return {};
+    prepare_frame_for_extraction();
+    extract_frame_packets();
+    collect_audio_packets();
+    return packet_views_;
 }
 
 std::vector<std::vector<std::byte> > VideoDecoder::decode_all_frames() {
     std::vector<std::vector<std::byte> > results;
     while (!eof_) {
-        for (auto packets = decode_next_frame(); auto &pkt: packets) {
-            results.push_back(std::move(pkt));
+        for (const auto &packet: decode_next_frame()) {
+            results.emplace_back(packet.begin(), packet.end());
         }
     }
     return results;
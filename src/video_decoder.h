@@ -20,7 +20,11 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <utility>
 #include <vector>
 
 extern "C" {
@@ -28,14 +32,20 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
+#include <libswresample/swresample.h>
 #include <libswscale/swscale.h>
 }
 
+#include "stream_input.h"
 #include "video_encoder.h"
 
 class VideoDecoder {
 public:
-    explicit VideoDecoder(const std::string &input_path);
+    // `input_path` may also be a URL or "-" for stdin (see StreamInput::is_stream_url); those are
+    // read through a background download with `read_ahead` bytes of buffer and cannot seek.
+    // `codec_threads` slice-decodes each frame in parallel; 0 uses one thread per core.
+    explicit VideoDecoder(const std::string &input_path, std::size_t read_ahead = STREAM_READ_AHEAD_BYTES,
+                          int codec_threads = 0);
 
     ~VideoDecoder();
 
@@ -47,43 +57,145 @@ public:
 
     VideoDecoder &operator=(VideoDecoder &&) = delete;
 
-    std::vector<std::vector<std::byte> > decode_next_frame();
+    using PacketView = std::span<const std::byte>;
+
+    // Framing health of one decoded frame. Pilot bits are the magic and version bytes at every
+    // position a packet should start at, compared against their known values.
+    struct FrameStats {
+        std::size_t pilot_bits = 0;
+        std::size_t pilot_bit_errors = 0;
+        std::size_t bad_magic = 0;       // expected packet starts without a valid magic
+        std::size_t resyncs = 0;         // times the scanner lost sync and searched for the next magic
+        std::size_t bytes_discarded = 0; // bytes skipped while resyncing
+        std::size_t soft_repaired = 0;   // CRC-failed packets fixed by soft-decision repair
+        std::size_t audio_packets = 0;   // packets read from the audio track, after the frame's own
+    };
+
+    // Packets of the next decoded frame, followed by any the audio track delivered meanwhile. The
+    // views point into internal buffers and are only valid until the next call.
+    const std::vector<PacketView> &decode_next_frame();
 
     std::vector<std::vector<std::byte> > decode_all_frames();
 
+    // The slab the last frame's packets were extracted into (audio track packets live elsewhere).
+    // While a copy of it is held, later frames are extracted into another slab, so views of those
+    // packets stay valid. Copies must be dropped on the thread that calls decode_next_frame().
+    [[nodiscard]] std::shared_ptr<const std::vector<std::byte> > frame_slab() const { return slab_; }
+
     [[nodiscard]] int64_t frames_read() const { return frame_index_; }
 
+    // Keep a confidence per extracted bit and try Chase repair on packets that fail their CRC
+    // before handing them out. Packet starts with a damaged magic are recovered too, since the
+    // magic and version bytes are known.
+    void set_soft_repair(const bool enable) { soft_repair_ = enable; }
+
+    [[nodiscard]] std::size_t packets_repaired() const { return packets_repaired_; }
+
+    // Stats for the frame returned by the last decode_next_frame() call.
+    [[nodiscard]] const FrameStats &frame_stats() const { return frame_stats_; }
+
     [[nodiscard]] int64_t total_frames() const;
 
+    [[nodiscard]] bool is_streaming() const { return stream_ != nullptr; }
+
+    // Bytes downloaded so far from a streamed input; 0 for local files.
+    [[nodiscard]] uint64_t bytes_streamed() const { return stream_ ? stream_->bytes_received() : 0; }
+
     [[nodiscard]] bool is_eof() const { return eof_; }
 
+    // Frame number of the most recently decoded frame, from its timestamp; -1 if unknown.
+    [[nodiscard]] int64_t current_frame() const { return current_frame_; }
+
+    // Packets a full frame carries, including those in its share of the audio track.
+    [[nodiscard]] std::size_t packets_per_frame(std::size_t packet_size) const;
+
+    // How frames are read (DCT density or direct pixels, luma or all planes): from the stream
+    // tags, else probed from the first frame that starts with a readable packet.
+    [[nodiscard]] const FrameLayout &layout() const { return layout_; }
+
+    // True when the input has an audio stream tagged as carrying packets.
+    [[nodiscard]] bool has_audio_track() const { return audio_stream_index_ >= 0; }
+
+    // Repositions so the next decoded frame is `frame`. Every frame is a keyframe, so this is
+    // exact whenever the container has an index. Returns false if the seek failed, and always
+    // for streamed inputs.
+    bool seek_to_frame(int64_t frame);
+
 private:
+    // Declared first so it outlives the format context reading from it.
+    std::unique_ptr<StreamInput> stream_;
     AVFormatContext *format_ctx_ = nullptr;
     AVCodecContext *codec_ctx_ = nullptr;
     AVFrame *frame_ = nullptr;
     AVFrame *gray_frame_ = nullptr;
     AVPacket *av_packet_ = nullptr;
     SwsContext *sws_ctx_ = nullptr;
+    AVCodecContext *audio_codec_ctx_ = nullptr;
+    AVFrame *audio_frame_ = nullptr;
+    // Only created when the audio decodes to something other than interleaved 16-bit samples.
+    SwrContext *swr_ctx_ = nullptr;
 
     int video_stream_index_ = -1;
+    int audio_stream_index_ = -1;
     int64_t frame_index_ = 0;
+    int64_t current_frame_ = -1;
     bool eof_ = false;
+    bool draining_ = false;
     bool is_gray8_ = false;
+    // Set when the decoded frames are planar 8-bit YUV, so chroma mode can read U and V.
+    std::optional<std::pair<int, int> > chroma_size_;
+    bool chroma_tagged_ = false;
     FrameLayout layout_{};
-    std::vector<std::byte> extract_buffer_{};
+    bool layout_known_ = false;
+    // Extracted bytes of the current frame, preceded by the partial packet carried over from
+    // the previous one. Reused for every frame unless a caller still holds it; packet views
+    // point straight into it.
+    std::shared_ptr<std::vector<std::byte> > slab_ = std::make_shared<std::vector<std::byte> >();
+    // Slabs given up while held, reused once every holder has let go.
+    std::vector<std::shared_ptr<std::vector<std::byte> > > spare_slabs_{};
+    std::size_t slab_consumed_ = 0;
+    std::vector<PacketView> packet_views_{};
+    FrameStats frame_stats_{};
+    uint8_t pilot_version_ = VERSION_ID_V2;
+    bool soft_repair_ = false;
+    // One byte per slab bit while soft repair is on: how far the projection was from zero.
+    std::vector<uint8_t> confidence_{};
+    std::size_t packets_repaired_ = 0;
+    // Decoded audio samples as bytes; everything before audio_consumed_ has been handed out.
+    std::vector<std::byte> audio_bytes_{};
+    std::size_t audio_consumed_ = 0;
 
-    void init_decoder(const std::string &input_path);
+    void init_decoder(const std::string &input_path, std::size_t read_ahead, int codec_threads);
 
-    [[nodiscard]] std::vector<std::byte> extract_data_from_frame() const;
+    void init_audio_decoder();
 
-    [[nodiscard]] std::vector<std::vector<std::byte> > extract_packets_from_frame() const;
+    void decode_audio_packet(const AVPacket *packet);
 
-    void extract_packets_from_buffer(std::vector<std::byte> &accumulated,
-                                     std::vector<std::vector<std::byte> > &out_packets);
+    void append_audio_samples();
 
-    void prepare_frame_for_extraction();
+    void collect_audio_packets();
+
+    [[nodiscard]] std::pair<const uint8_t *, int> gray_plane() const;
+
+    void extract_data_from_frame(std::span<std::byte> out, std::span<uint8_t> confidence) const;
+
+    void extract_with_layout(const FrameLayout &layout, uint8_t *out, int bytes, uint8_t *conf) const;
+
+    [[nodiscard]] bool chroma_planes_active() const;
 
-    [[nodiscard]] std::vector<std::vector<std::byte> > accumulate_frame_and_extract_packets();
+    bool detect_layout();
+
+    void count_pilot_errors(std::span<const std::byte> packet_start);
+
+    // Swaps in a slab nobody else holds, seeded with the last `carried` bytes; false if the
+    // current one was free already.
+    bool detach_slab(std::size_t carried);
+
+    void scan_slab_for_packets(std::size_t frame_start);
+
+    void repair_failed_packets();
+
+    void prepare_frame_for_extraction();
 
-    [[nodiscard]] std::vector<std::vector<std::byte> > flush_decoder_and_collect_packets();
+    void extract_frame_packets();
 };
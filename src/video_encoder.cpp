@@ -15,32 +15,246 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "video_encoder.h"
+#include "codec_profile.h"
 #include "configuration.h"
-#include "dct_common.h"
 
 #include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <stdexcept>
 
-FrameLayout compute_frame_layout() {
+static void check_frame_size(const int width, const int height) {
+    for (const int side: {width, height}) {
+        if (side < 8 || side > MAX_FRAME_DIMENSION || side % 8 != 0) {
+            throw std::runtime_error("frame size " + std::to_string(width) + "x" + std::to_string(height) +
+                                     " must be a multiple of 8 between 8 and " +
+                                     std::to_string(MAX_FRAME_DIMENSION) + " on each side");
+        }
+    }
+}
+
+FrameLayout compute_frame_layout(const int bits_per_block, const int width, const int height) {
+    if (bits_per_block < 1 || bits_per_block > MAX_BITS_PER_BLOCK) {
+        throw std::runtime_error("bits per block must be between 1 and " + std::to_string(MAX_BITS_PER_BLOCK));
+    }
+    check_frame_size(width, height);
     FrameLayout layout{};
-    layout.frame_width = FRAME_WIDTH;
-    layout.frame_height = FRAME_HEIGHT;
-    layout.blocks_per_row = FRAME_WIDTH / 8;
-    layout.blocks_per_col = FRAME_HEIGHT / 8;
-    layout.total_blocks = layout.blocks_per_row * layout.blocks_per_col;
-    layout.bits_per_frame = layout.total_blocks * BITS_PER_BLOCK;
+    layout.frame_width = width;
+    layout.frame_height = height;
+    layout.bits_per_block = bits_per_block;
+    layout.blocks_per_row = width / 8;
+    layout.blocks_per_col = height / 8;
+    // Only whole groups of blocks carry data, so every frame holds a whole number of bytes.
+    const int group = blocks_per_group(bits_per_block);
+    layout.total_blocks = layout.blocks_per_row * layout.blocks_per_col / group * group;
+    layout.bits_per_frame = layout.total_blocks * bits_per_block;
     layout.bytes_per_frame = layout.bits_per_frame / 8;
     return layout;
 }
 
-std::size_t max_packet_bytes_per_frame() {
-    return static_cast<std::size_t>(compute_frame_layout().bytes_per_frame);
+FrameLayout compute_direct_frame_layout(const int bits_per_pixel, const int width, const int height) {
+    if (bits_per_pixel != 1 && bits_per_pixel != 2 && bits_per_pixel != 4 && bits_per_pixel != 8) {
+        throw std::runtime_error("direct embedding takes 1, 2, 4 or 8 bits per pixel");
+    }
+    check_frame_size(width, height);
+    FrameLayout layout{};
+    layout.frame_width = width;
+    layout.frame_height = height;
+    layout.bits_per_pixel = bits_per_pixel;
+    layout.bits_per_frame = width * height * bits_per_pixel;
+    layout.bytes_per_frame = layout.bits_per_frame / 8;
+    return layout;
 }
 
-VideoEncoder::VideoEncoder(const std::string &output_path) {
-    init_encoder(output_path);
+FrameLayout with_chroma_planes(const FrameLayout &luma, const int chroma_width, const int chroma_height) {
+    FrameLayout layout = luma;
+    layout.chroma_width = chroma_width;
+    layout.chroma_height = chroma_height;
+    const FrameLayout chroma = plane_layout(layout, 1);
+    layout.bits_per_frame += 2 * chroma.bits_per_frame;
+    layout.bytes_per_frame += 2 * chroma.bytes_per_frame;
+    return layout;
+}
+
+FrameLayout plane_layout(const FrameLayout &layout, const int plane) {
+    const int width = plane == 0 ? layout.frame_width : layout.chroma_width;
+    const int height = plane == 0 ? layout.frame_height : layout.chroma_height;
+    return layout.bits_per_pixel != 0
+               ? compute_direct_frame_layout(layout.bits_per_pixel, width, height)
+               : compute_frame_layout(layout.bits_per_block, width, height);
+}
+
+std::optional<std::pair<int, int> > chroma_plane_size(const AVPixelFormat format, const int width, const int height) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    if (!desc || desc->nb_components != 3 || !(desc->flags & AV_PIX_FMT_FLAG_PLANAR) ||
+        (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL)) || desc->comp[0].depth != 8) {
+        return std::nullopt;
+    }
+    return std::pair{AV_CEIL_RSHIFT(width, desc->log2_chroma_w), AV_CEIL_RSHIFT(height, desc->log2_chroma_h)};
+}
+
+std::size_t max_packet_bytes_per_frame(const int bits_per_block) {
+    return static_cast<std::size_t>(compute_frame_layout(bits_per_block).bytes_per_frame);
+}
+
+namespace {
+    // Copies one N-byte row segment with the widest stores available.
+    template<int N>
+    void store_segment(uint8_t *dst, const uint8_t *src) {
+#if defined(__AVX512F__)
+        if constexpr (N == 64) {
+            _mm512_storeu_si512(dst, _mm512_loadu_si512(src));
+            return;
+        }
+#endif
+#if defined(DCT_USE_AVX)
+        if constexpr (N % 32 == 0) {
+            for (int i = 0; i < N; i += 32) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                                    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)));
+            }
+            return;
+        }
+#endif
+#if defined(DCT_USE_AVX) || defined(DCT_USE_SSE2)
+        if constexpr (N % 16 == 0) {
+            for (int i = 0; i < N; i += 16) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                                 _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+            }
+            return;
+        }
+#endif
+        std::memcpy(dst, src, N);
+    }
+
+    // At 1, 2 or 4 bits per block a source byte covers 8, 4 or 2 whole blocks. Entry (value, y)
+    // holds row y of those blocks side by side: 64, 32 or 16 pixels.
+    std::vector<uint8_t> make_byte_rows(const PrecomputedBlocks &blocks, const int bits) {
+        const int per_byte = 8 / bits;
+        const int segment = per_byte * 8;
+        std::vector<uint8_t> rows(static_cast<std::size_t>(256) * 8 * segment);
+        for (int value = 0; value < 256; ++value) {
+            for (int k = 0; k < per_byte; ++k) {
+                const int pattern = (value >> (8 - bits * (k + 1))) & ((1 << bits) - 1);
+                for (int y = 0; y < 8; ++y) {
+                    std::memcpy(&rows[(static_cast<std::size_t>(value) * 8 + y) * segment + k * 8],
+                                blocks.patterns[pattern][y], 8);
+                }
+            }
+        }
+        return rows;
+    }
+
+    // Row-band kernel: each band of 8 pixel rows is one row of blocks, written a full pixel row at
+    // a time from the byte table, so the frame is filled with long sequential stores.
+    template<int Bits>
+    void embed_bands(const std::vector<uint8_t> &byte_rows, const uint8_t *src, const std::size_t size,
+                     const int blocks_per_row, uint8_t *dst_base, const int dst_stride) {
+        constexpr int per_byte = 8 / Bits;
+        constexpr int segment = per_byte * 8;
+        const int bytes_per_band = blocks_per_row / per_byte;
+        const int bands = static_cast<int>((size + bytes_per_band - 1) / bytes_per_band);
+
+#pragma omp parallel for schedule(static)
+        for (int band = 0; band < bands; ++band) {
+            const std::size_t first = static_cast<std::size_t>(band) * bytes_per_band;
+            const uint8_t *band_src = src + first;
+            const int count = static_cast<int>(std::min<std::size_t>(bytes_per_band, size - first));
+            for (int y = 0; y < 8; ++y) {
+                uint8_t *row = dst_base + (static_cast<std::size_t>(band) * 8 + y) * dst_stride;
+                const uint8_t *table = byte_rows.data() + static_cast<std::size_t>(y) * segment;
+                for (int i = 0; i < count; ++i) {
+                    store_segment<segment>(row + i * segment,
+                                           table + static_cast<std::size_t>(band_src[i]) * 8 * segment);
+                }
+            }
+        }
+    }
+
+    // Sets every block from `first_block` on to neutral gray. Blocks carrying data are written by
+    // the kernels, so a frame is never cleared as a whole first.
+    void fill_unused_blocks(const FrameLayout &plane, const int first_block, uint8_t *dst_base, const int dst_stride) {
+        const int blocks_per_row = plane.blocks_per_row;
+        int band = first_block / blocks_per_row;
+        if (const int col = first_block % blocks_per_row; col != 0) {
+            for (int y = 0; y < 8; ++y) {
+                std::memset(dst_base + static_cast<std::size_t>(band * 8 + y) * dst_stride + col * 8, 128,
+                            static_cast<std::size_t>(blocks_per_row - col) * 8);
+            }
+            ++band;
+        }
+        for (int y = band * 8; y < plane.frame_height; ++y) {
+            std::memset(dst_base + static_cast<std::size_t>(y) * dst_stride, 128, plane.frame_width);
+        }
+    }
+
+    // Fallback for 3 bits per block, and for widths a byte's blocks would wrap across: writes the
+    // pattern block for each of the first `active_blocks` blocks, taking Bits bits of `src` per
+    // block; past `total_bits` the pattern is padded with zero bits.
+    template<int Bits>
+    void embed_blocks(const PrecomputedBlocks &blocks, const uint8_t *src, const std::size_t total_bits,
+                      const int active_blocks, const int blocks_per_row, uint8_t *dst_base, const int dst_stride) {
+        const auto &patterns = blocks.patterns;
+
+#pragma omp parallel for schedule(static)
+        for (int block_idx = 0; block_idx < active_blocks; ++block_idx) {
+            const int block_row = block_idx / blocks_per_row;
+            const int block_col = block_idx % blocks_per_row;
+            const int base_x = block_col * 8;
+            const int base_y = block_row * 8;
+
+            const std::size_t bit_start = static_cast<std::size_t>(block_idx) * Bits;
+            int pattern = 0;
+            for (int b = 0; b < Bits; ++b) {
+                const std::size_t bit_index = bit_start + b;
+                const int bit = bit_index < total_bits ? (src[bit_index / 8] >> (7 - bit_index % 8)) & 1 : 0;
+                pattern = (pattern << 1) | bit;
+            }
+
+            const auto &block = patterns[pattern];
+            for (int y = 0; y < 8; ++y) {
+                std::memcpy(dst_base + (base_y + y) * dst_stride + base_x, block[y], 8);
+            }
+        }
+    }
+
+    // Direct mode: Bits bits of `src` per pixel in raster order, as one of 2^Bits levels spread
+    // over 0..255. Pixels past the data are level 0.
+    template<int Bits>
+    void embed_pixels(const uint8_t *src, const std::size_t size, const int width, const int height,
+                      uint8_t *dst_base, const int dst_stride) {
+        constexpr int pixels_per_byte = 8 / Bits;
+        constexpr int step = 255 / ((1 << Bits) - 1);
+        const int row_bytes = width / pixels_per_byte;
+
+#pragma omp parallel for schedule(static)
+        for (int y = 0; y < height; ++y) {
+            uint8_t *row = dst_base + static_cast<std::size_t>(y) * dst_stride;
+            const std::size_t first = static_cast<std::size_t>(y) * row_bytes;
+            const std::size_t count = first < size ? std::min<std::size_t>(row_bytes, size - first) : 0;
+            if constexpr (Bits == 8) {
+                std::memcpy(row, src + first, count);
+            } else {
+                for (std::size_t i = 0; i < count; ++i) {
+                    const uint8_t value = src[first + i];
+                    for (int sub = 0; sub < pixels_per_byte; ++sub) {
+                        const int symbol = (value >> (8 - Bits * (sub + 1))) & ((1 << Bits) - 1);
+                        row[i * pixels_per_byte + sub] = static_cast<uint8_t>(symbol * step);
+                    }
+                }
+            }
+            std::memset(row + count * pixels_per_byte, 0, width - count * pixels_per_byte);
+        }
+    }
+}
+
+VideoEncoder::FrameSlot::~FrameSlot() {
+    if (frame) av_frame_free(&frame);
+}
+
+VideoEncoder::VideoEncoder(const std::string &output_path, const VideoEncoderOptions &options) {
+    init_encoder(output_path, options);
 }
 
 VideoEncoder::~VideoEncoder() {
@@ -48,25 +262,79 @@ VideoEncoder::~VideoEncoder() {
         try { finalize(); } catch (...) {
         }
     }
+    if (writer.joinable()) {
+        frame_queue->close();
+        writer.join();
+    }
+    frame_queue.reset();
+    if (audio_frame) av_frame_free(&audio_frame);
+    if (audio_codec_ctx) avcodec_free_context(&audio_codec_ctx);
     if (sws_ctx) sws_freeContext(sws_ctx);
     if (av_packet) av_packet_free(&av_packet);
-    if (frame) av_frame_free(&frame);
     if (codec_ctx) avcodec_free_context(&codec_ctx);
     if (format_ctx) {
-        if (format_ctx->pb) avio_closep(&format_ctx->pb);
+        if (format_ctx->pb && !sink_) avio_closep(&format_ctx->pb);
         avformat_free_context(format_ctx);
     }
 }
 
-void VideoEncoder::init_encoder(const std::string &output_path) {
-    int ret = avformat_alloc_output_context2(&format_ctx, nullptr, nullptr, output_path.c_str());
+void VideoEncoder::init_encoder(const std::string &output_path, const VideoEncoderOptions &options) {
+    const CodecProfile *profile = find_codec_profile(options.profile);
+    if (!profile) {
+        throw std::runtime_error("Unknown codec profile: " + options.profile);
+    }
+
+    // An explicit density or depth overrides the profile's embedding; an explicit density also
+    // turns a direct profile back to DCT embedding.
+    int direct_bits_per_pixel = options.direct_bits_per_pixel;
+    if (direct_bits_per_pixel == 0 && options.bits_per_block == 0) {
+        direct_bits_per_pixel = profile->direct_bits_per_pixel;
+    }
+    if (direct_bits_per_pixel != 0) {
+        // Pixel values have to come back exactly, which only a lossless profile guarantees.
+        if (!profile->lossless) {
+            throw std::runtime_error(std::string("Direct embedding needs a lossless codec profile, not ") +
+                                     profile->name);
+        }
+        layout_ = compute_direct_frame_layout(direct_bits_per_pixel, options.frame_width, options.frame_height);
+    } else {
+        layout_ = compute_frame_layout(options.bits_per_block != 0 ? options.bits_per_block : profile->bits_per_block,
+                                       options.frame_width, options.frame_height);
+        blocks_ = make_precomputed_blocks(layout_.bits_per_block, profile->strength);
+        if (layout_.bits_per_block != 3) {
+            byte_rows_ = make_byte_rows(blocks_, layout_.bits_per_block);
+        }
+    }
+    if (packets_per_frame() == 0) {
+        throw std::runtime_error("frame size " + std::to_string(layout_.frame_width) + "x" +
+                                 std::to_string(layout_.frame_height) + " cannot hold a single packet");
+    }
+
+    int ret = avformat_alloc_output_context2(&format_ctx, nullptr, profile->container, output_path.c_str());
     if (ret < 0 || !format_ctx) {
         throw std::runtime_error("Failed to create output context");
     }
 
-    const AVCodec *codec = avcodec_find_encoder_by_name(VIDEO_CODEC.c_str());
+    const AVCodec *codec = avcodec_find_encoder_by_name(profile->codec);
     if (!codec) {
-        throw std::runtime_error("Failed to find encoder: " + VIDEO_CODEC);
+        throw std::runtime_error(std::string("Failed to find encoder: ") + profile->codec);
+    }
+    const AVPixelFormat pix_fmt = av_get_pix_fmt(profile->pixel_format);
+    if (pix_fmt == AV_PIX_FMT_NONE) {
+        throw std::runtime_error(std::string("Unknown pixel format: ") + profile->pixel_format);
+    }
+    if (options.chroma) {
+        const auto chroma = chroma_plane_size(pix_fmt, layout_.frame_width, layout_.frame_height);
+        if (!chroma) {
+            throw std::runtime_error(std::string("Chroma embedding needs a planar YUV codec profile, not ") +
+                                     profile->name);
+        }
+        const auto [chroma_width, chroma_height] = *chroma;
+        if (chroma_width % 8 != 0 || chroma_height % 8 != 0) {
+            throw std::runtime_error("Chroma planes of " + std::to_string(chroma_width) + "x" +
+                                     std::to_string(chroma_height) + " do not tile into 8x8 blocks");
+        }
+        layout_ = with_chroma_planes(layout_, chroma_width, chroma_height);
     }
 
     stream = avformat_new_stream(format_ctx, nullptr);
@@ -79,18 +347,33 @@ void VideoEncoder::init_encoder(const std::string &output_path) {
         throw std::runtime_error("Failed to allocate codec context");
     }
 
-    codec_ctx->width = FRAME_WIDTH;
-    codec_ctx->height = FRAME_HEIGHT;
+    codec_ctx->width = layout_.frame_width;
+    codec_ctx->height = layout_.frame_height;
     codec_ctx->time_base = {1, FRAME_FPS};
     codec_ctx->framerate = {FRAME_FPS, 1};
     codec_ctx->gop_size = 30;
     codec_ctx->max_b_frames = 0;
-    codec_ctx->pix_fmt = AV_PIX_FMT_GRAY8;
+    codec_ctx->pix_fmt = pix_fmt;
 
     if (format_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
         codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
     }
 
+    codec_ctx->thread_count = options.codec_threads;
+    codec_ctx->thread_type = FF_THREAD_SLICE;
+    for (const auto &[key, value]: profile->options) {
+        if (av_opt_set(codec_ctx, key, value, AV_OPT_SEARCH_CHILDREN) < 0) {
+            throw std::runtime_error(std::string("Codec profile ") + profile->name + " sets unknown option " + key);
+        }
+    }
+    if (std::string_view(profile->codec) == "ffv1") {
+        // Slices need FFV1 version 3 (the profile's level); each one is coded independently, so
+        // they spread across the codec threads, and the per-slice CRC lets a decoder isolate a
+        // damaged slice.
+        av_opt_set_int(codec_ctx, "slices", options.slices, AV_OPT_SEARCH_CHILDREN);
+        av_opt_set_int(codec_ctx, "slicecrc", options.slice_crc ? 1 : 0, AV_OPT_SEARCH_CHILDREN);
+    }
+
     ret = avcodec_open2(codec_ctx, codec, nullptr);
     if (ret < 0) {
         char error_buffer[256];
@@ -104,19 +387,14 @@ void VideoEncoder::init_encoder(const std::string &output_path) {
     }
 
     stream->time_base = codec_ctx->time_base;
-
-    frame = av_frame_alloc();
-    if (!frame) {
-        throw std::runtime_error("Failed to allocate frame");
+    // Lets the decoder pick the right extraction mode and density without probing.
+    if (layout_.bits_per_pixel != 0) {
+        av_dict_set_int(&stream->metadata, BITS_PER_PIXEL_TAG, layout_.bits_per_pixel, 0);
+    } else {
+        av_dict_set_int(&stream->metadata, BITS_PER_BLOCK_TAG, layout_.bits_per_block, 0);
     }
-
-    frame->format = codec_ctx->pix_fmt;
-    frame->width = codec_ctx->width;
-    frame->height = codec_ctx->height;
-
-    ret = av_frame_get_buffer(frame, 0);
-    if (ret < 0) {
-        throw std::runtime_error("Failed to allocate frame buffer");
+    if (layout_.chroma_width != 0) {
+        av_dict_set_int(&stream->metadata, CHROMA_PLANES_TAG, 1, 0);
     }
 
     av_packet = av_packet_alloc();
@@ -124,11 +402,11 @@ void VideoEncoder::init_encoder(const std::string &output_path) {
         throw std::runtime_error("Failed to allocate packet");
     }
 
-    if (codec_ctx->pix_fmt != AV_PIX_FMT_GRAY8) {
-        gray_buffer.resize(static_cast<std::size_t>(FRAME_WIDTH) * FRAME_HEIGHT);
+    // Chroma mode writes every plane itself; otherwise a gray frame is converted for the codec.
+    if (codec_ctx->pix_fmt != AV_PIX_FMT_GRAY8 && layout_.chroma_width == 0) {
         sws_ctx = sws_getContext(
-            FRAME_WIDTH, FRAME_HEIGHT, AV_PIX_FMT_GRAY8,
-            FRAME_WIDTH, FRAME_HEIGHT, codec_ctx->pix_fmt,
+            layout_.frame_width, layout_.frame_height, AV_PIX_FMT_GRAY8,
+            layout_.frame_width, layout_.frame_height, codec_ctx->pix_fmt,
             SWS_POINT, nullptr, nullptr, nullptr
         );
         if (!sws_ctx) {
@@ -136,11 +414,19 @@ void VideoEncoder::init_encoder(const std::string &output_path) {
         }
     }
 
-    layout_ = compute_frame_layout();
     frame_data_buffer.reserve(layout_.bytes_per_frame);
 
-    ret = avio_open(&format_ctx->pb, output_path.c_str(), AVIO_FLAG_WRITE);
-    if (ret < 0) {
+    if (options.audio != AudioTrack::None) {
+        init_audio(options.audio);
+    }
+
+    // A streamed output cannot seek, so the muxer leaves out the cues and sizes it would
+    // otherwise go back to write, and the decoder reads the result front to back.
+    if (StreamOutput::is_stream_url(output_path)) {
+        sink_ = std::make_unique<StreamOutput>(output_path, options.write_behind);
+        format_ctx->pb = sink_->context();
+        format_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    } else if (avio_open(&format_ctx->pb, output_path.c_str(), AVIO_FLAG_WRITE) < 0) {
         throw std::runtime_error("Failed to open output file");
     }
 
@@ -148,91 +434,213 @@ void VideoEncoder::init_encoder(const std::string &output_path) {
     if (ret < 0) {
         throw std::runtime_error("Failed to write header");
     }
+
+    frame_queue = std::make_unique<SpscQueue<FrameSlot> >(options.queue_frames);
+    writer = std::jthread([this] { write_frames(); });
 }
 
-int VideoEncoder::packets_per_frame() {
-    const auto layout = compute_frame_layout();
+void VideoEncoder::init_audio(const AudioTrack audio) {
+    const char *name = audio == AudioTrack::Flac ? "flac" : "pcm_s16le";
+    const AVCodec *codec = avcodec_find_encoder_by_name(name);
+    if (!codec) {
+        throw std::runtime_error(std::string("Failed to find audio encoder: ") + name);
+    }
+
+    audio_stream = avformat_new_stream(format_ctx, nullptr);
+    if (!audio_stream) {
+        throw std::runtime_error("Failed to create audio stream");
+    }
+
+    audio_codec_ctx = avcodec_alloc_context3(codec);
+    if (!audio_codec_ctx) {
+        throw std::runtime_error("Failed to allocate audio codec context");
+    }
+    audio_codec_ctx->sample_rate = AUDIO_SAMPLE_RATE;
+    audio_codec_ctx->sample_fmt = AV_SAMPLE_FMT_S16;
+    audio_codec_ctx->time_base = {1, AUDIO_SAMPLE_RATE};
+    av_channel_layout_default(&audio_codec_ctx->ch_layout, AUDIO_CHANNELS);
+    // FLAC takes its block size from here, so each block lines up with a video frame.
+    audio_codec_ctx->frame_size = AUDIO_SAMPLES_PER_FRAME;
+    if (format_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+        audio_codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    int ret = avcodec_open2(audio_codec_ctx, codec, nullptr);
+    if (ret < 0) {
+        throw std::runtime_error(std::string("Failed to open audio codec: ") + name);
+    }
+    if (audio_codec_ctx->frame_size != 0 && audio_codec_ctx->frame_size != AUDIO_SAMPLES_PER_FRAME) {
+        throw std::runtime_error(std::string("Audio codec ") + name + " does not take one frame per video frame");
+    }
+
+    ret = avcodec_parameters_from_context(audio_stream->codecpar, audio_codec_ctx);
+    if (ret < 0) {
+        throw std::runtime_error("Failed to copy audio codec parameters");
+    }
+    audio_stream->time_base = audio_codec_ctx->time_base;
+    av_dict_set_int(&audio_stream->metadata, AUDIO_PACKETS_TAG, 1, 0);
+
+    audio_frame = av_frame_alloc();
+    if (!audio_frame) {
+        throw std::runtime_error("Failed to allocate audio frame");
+    }
+    audio_frame->format = audio_codec_ctx->sample_fmt;
+    audio_frame->sample_rate = AUDIO_SAMPLE_RATE;
+    audio_frame->nb_samples = AUDIO_SAMPLES_PER_FRAME;
+    av_channel_layout_copy(&audio_frame->ch_layout, &audio_codec_ctx->ch_layout);
+    if (av_frame_get_buffer(audio_frame, 0) < 0) {
+        throw std::runtime_error("Failed to allocate audio frame buffer");
+    }
+
+    audio_bytes_per_frame = static_cast<std::size_t>(AUDIO_SAMPLES_PER_FRAME) * AUDIO_CHANNELS * sizeof(int16_t);
+    audio_data_buffer.reserve(audio_bytes_per_frame);
+}
+
+int VideoEncoder::packets_per_frame() const {
     constexpr std::size_t packet_size = HEADER_SIZE_V2 + SYMBOL_SIZE_BYTES;
-    return static_cast<int>(layout.bytes_per_frame / packet_size);
+    return static_cast<int>(layout_.bytes_per_frame / packet_size);
 }
 
-void VideoEncoder::embed_data_in_frame(const std::vector<std::byte> &data) {
-    const auto &blocks = get_precomputed_blocks();
-    const auto &patterns = blocks.patterns;
+int VideoEncoder::audio_packets_per_frame() const {
+    constexpr std::size_t packet_size = HEADER_SIZE_V2 + SYMBOL_SIZE_BYTES;
+    return static_cast<int>(audio_bytes_per_frame / packet_size);
+}
 
-    const std::size_t total_bits = data.size() * 8;
-    const int total_blocks = layout_.blocks_per_row * layout_.blocks_per_col;
-    const int active_blocks = static_cast<int>(
-        std::min(static_cast<std::size_t>(total_blocks),
-                 (total_bits + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK));
+void VideoEncoder::prepare_slot(FrameSlot &slot) const {
+    if (slot.frame) {
+        // The codec may still reference the buffer of a frame it was given earlier.
+        if (av_frame_make_writable(slot.frame) < 0) {
+            throw std::runtime_error("Frame not writable");
+        }
+        return;
+    }
+
+    slot.frame = av_frame_alloc();
+    if (!slot.frame) {
+        throw std::runtime_error("Failed to allocate frame");
+    }
+    slot.frame->format = codec_ctx->pix_fmt;
+    slot.frame->width = codec_ctx->width;
+    slot.frame->height = codec_ctx->height;
+    if (av_frame_get_buffer(slot.frame, 0) < 0) {
+        throw std::runtime_error("Failed to allocate frame buffer");
+    }
+    if (sws_ctx) {
+        slot.gray_buffer.resize(static_cast<std::size_t>(layout_.frame_width) * layout_.frame_height);
+    }
+}
+
+void VideoEncoder::embed_data_in_frame(const std::vector<std::byte> &data, FrameSlot &slot) const {
     const auto *src = reinterpret_cast<const uint8_t *>(data.data());
-    const int blocks_per_row = layout_.blocks_per_row;
+    AVFrame *frame = slot.frame;
+
+    if (layout_.chroma_width != 0) {
+        std::size_t offset = 0;
+        for (int p = 0; p < 3; ++p) {
+            const FrameLayout plane = plane_layout(layout_, p);
+            const std::size_t start = std::min(offset, data.size());
+            const std::size_t size = std::min<std::size_t>(plane.bytes_per_frame, data.size() - start);
+            embed_plane(plane, src + start, size, frame->data[p], frame->linesize[p]);
+            offset += plane.bytes_per_frame;
+        }
+        return;
+    }
 
     uint8_t *dst_base;
     int dst_stride;
     if (sws_ctx) {
-        dst_base = gray_buffer.data();
-        dst_stride = FRAME_WIDTH;
-        std::memset(dst_base, 128, gray_buffer.size());
+        dst_base = slot.gray_buffer.data();
+        dst_stride = layout_.frame_width;
     } else {
-        av_frame_make_writable(frame);
         dst_base = frame->data[0];
         dst_stride = frame->linesize[0];
-        for (int y = 0; y < FRAME_HEIGHT; ++y)
-            std::memset(dst_base + y * dst_stride, 128, FRAME_WIDTH);
     }
 
-#pragma omp parallel for schedule(static)
-    for (int block_idx = 0; block_idx < active_blocks; ++block_idx) {
-        const int block_row = block_idx / blocks_per_row;
-        const int block_col = block_idx % blocks_per_row;
-        const int base_x = block_col * 8;
-        const int base_y = block_row * 8;
-
-        const std::size_t bit_start = static_cast<std::size_t>(block_idx) * BITS_PER_BLOCK;
-        const std::size_t bit_end = std::min(bit_start + BITS_PER_BLOCK, total_bits);
-
-        int pattern = 0;
-        for (std::size_t bit_index = bit_start; bit_index < bit_end; ++bit_index) {
-            const std::size_t byte_idx = bit_index / 8;
-            const int bit_pos = 7 - static_cast<int>(bit_index % 8);
-            const int bit = (src[byte_idx] >> bit_pos) & 1;
-            pattern = (pattern << 1) | bit;
-        }
-
-        const int bits_extracted = static_cast<int>(bit_end - bit_start);
-        pattern <<= (BITS_PER_BLOCK - bits_extracted);
-
-        const auto &block = patterns[pattern];
-        for (int y = 0; y < 8; ++y) {
-            std::memcpy(dst_base + (base_y + y) * dst_stride + base_x,
-                        block[y], 8);
-        }
-    }
+    embed_plane(layout_, src, data.size(), dst_base, dst_stride);
 
     if (sws_ctx) {
-        const uint8_t *src_data[1] = {gray_buffer.data()};
-        constexpr int src_linesize[1] = {FRAME_WIDTH};
-        sws_scale(sws_ctx, src_data, src_linesize, 0, FRAME_HEIGHT,
+        const uint8_t *src_data[1] = {slot.gray_buffer.data()};
+        const int src_linesize[1] = {layout_.frame_width};
+        sws_scale(sws_ctx, src_data, src_linesize, 0, layout_.frame_height,
                   frame->data, frame->linesize);
     }
 }
 
-void VideoEncoder::encode_frame() {
-    int ret = av_frame_make_writable(frame);
-    if (ret < 0) {
-        throw std::runtime_error("Frame not writable");
+void VideoEncoder::embed_plane(const FrameLayout &plane, const uint8_t *src, const std::size_t size,
+                               uint8_t *dst_base, const int dst_stride) const {
+    // Direct mode writes every pixel; the DCT patterns only cover the blocks that carry data.
+    const int width = plane.frame_width;
+    const int height = plane.frame_height;
+    switch (plane.bits_per_pixel) {
+        case 1:
+            embed_pixels<1>(src, size, width, height, dst_base, dst_stride);
+            break;
+        case 2:
+            embed_pixels<2>(src, size, width, height, dst_base, dst_stride);
+            break;
+        case 4:
+            embed_pixels<4>(src, size, width, height, dst_base, dst_stride);
+            break;
+        case 8:
+            embed_pixels<8>(src, size, width, height, dst_base, dst_stride);
+            break;
+        default:
+            embed_dct_blocks(plane, src, size, dst_base, dst_stride);
+            break;
     }
+}
 
-    frame->pts = frame_index++;
+void VideoEncoder::embed_dct_blocks(const FrameLayout &plane, const uint8_t *src, const std::size_t size,
+                                    uint8_t *dst_base, const int dst_stride) const {
+    const int bits_per_block = plane.bits_per_block;
+    const std::size_t total_bits = size * 8;
+    const int active_blocks = static_cast<int>(
+        std::min(static_cast<std::size_t>(plane.total_blocks),
+                 (total_bits + bits_per_block - 1) / bits_per_block));
+    const int blocks_per_row = plane.blocks_per_row;
+
+    if (!byte_rows_.empty() && blocks_per_row % (8 / bits_per_block) == 0) {
+        const std::size_t bytes = std::min<std::size_t>(size, plane.bytes_per_frame);
+        switch (bits_per_block) {
+            case 1:
+                embed_bands<1>(byte_rows_, src, bytes, blocks_per_row, dst_base, dst_stride);
+                break;
+            case 2:
+                embed_bands<2>(byte_rows_, src, bytes, blocks_per_row, dst_base, dst_stride);
+                break;
+            default:
+                embed_bands<4>(byte_rows_, src, bytes, blocks_per_row, dst_base, dst_stride);
+                break;
+        }
+        fill_unused_blocks(plane, static_cast<int>(bytes * 8 / bits_per_block), dst_base, dst_stride);
+        return;
+    }
 
-    ret = avcodec_send_frame(codec_ctx, frame);
+    switch (bits_per_block) {
+        case 1:
+            embed_blocks<1>(blocks_, src, total_bits, active_blocks, blocks_per_row, dst_base, dst_stride);
+            break;
+        case 2:
+            embed_blocks<2>(blocks_, src, total_bits, active_blocks, blocks_per_row, dst_base, dst_stride);
+            break;
+        case 3:
+            embed_blocks<3>(blocks_, src, total_bits, active_blocks, blocks_per_row, dst_base, dst_stride);
+            break;
+        default:
+            embed_blocks<4>(blocks_, src, total_bits, active_blocks, blocks_per_row, dst_base, dst_stride);
+            break;
+    }
+    fill_unused_blocks(plane, active_blocks, dst_base, dst_stride);
+}
+
+void VideoEncoder::encode_frame(AVCodecContext *ctx, const AVStream *st, AVFrame *frame) {
+    int ret = avcodec_send_frame(ctx, frame);
     if (ret < 0) {
         throw std::runtime_error("Error sending frame");
     }
 
     while (true) {
-        ret = avcodec_receive_packet(codec_ctx, av_packet);
+        ret = avcodec_receive_packet(ctx, av_packet);
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             break;
         }
@@ -240,8 +648,8 @@ void VideoEncoder::encode_frame() {
             throw std::runtime_error("Error receiving packet");
         }
 
-        av_packet_rescale_ts(av_packet, codec_ctx->time_base, stream->time_base);
-        av_packet->stream_index = stream->index;
+        av_packet_rescale_ts(av_packet, ctx->time_base, st->time_base);
+        av_packet->stream_index = st->index;
 
         ret = av_interleaved_write_frame(format_ctx, av_packet);
         if (ret < 0) {
@@ -252,6 +660,18 @@ void VideoEncoder::encode_frame() {
     }
 }
 
+void VideoEncoder::encode_audio(const std::vector<std::byte> &data, const int64_t pts) {
+    // Samples are the packet bytes as interleaved little-endian 16-bit values; the rest of the
+    // frame is silence.
+    if (av_frame_make_writable(audio_frame) < 0) {
+        throw std::runtime_error("Audio frame not writable");
+    }
+    std::memcpy(audio_frame->data[0], data.data(), data.size());
+    std::memset(audio_frame->data[0] + data.size(), 0, audio_bytes_per_frame - data.size());
+    audio_frame->pts = pts * AUDIO_SAMPLES_PER_FRAME;
+    encode_frame(audio_codec_ctx, audio_stream, audio_frame);
+}
+
 void VideoEncoder::add_packet(const Packet &packet) {
     if (finalized) {
         throw std::runtime_error("Encoder already finalized");
@@ -259,6 +679,11 @@ void VideoEncoder::add_packet(const Packet &packet) {
 
     if (const auto max_bytes = static_cast<std::size_t>(layout_.bytes_per_frame);
         frame_data_buffer.size() + packet.bytes.size() > max_bytes) {
+        // A full frame overflows into its audio frame before both are written.
+        if (audio_data_buffer.size() + packet.bytes.size() <= audio_bytes_per_frame) {
+            audio_data_buffer.insert(audio_data_buffer.end(), packet.bytes.begin(), packet.bytes.end());
+            return;
+        }
         flush_frame_buffer();
     }
 
@@ -276,16 +701,48 @@ void VideoEncoder::encode_packets(const std::vector<Packet> &packets) {
 void VideoEncoder::flush_frame_buffer() {
     if (frame_data_buffer.empty()) return;
 
-    embed_data_in_frame(frame_data_buffer);
-    encode_frame();
+    if (writer_failed.load(std::memory_order_acquire)) {
+        std::rethrow_exception(writer_error);
+    }
+    frame_queue->push([&](FrameSlot &slot) {
+        prepare_slot(slot);
+        embed_data_in_frame(frame_data_buffer, slot);
+        slot.frame->pts = frame_index++;
+        slot.audio.assign(audio_data_buffer.begin(), audio_data_buffer.end());
+    });
     frame_data_buffer.clear();
+    audio_data_buffer.clear();
 }
 
-void VideoEncoder::flush_encoder() const {
-    int ret = avcodec_send_frame(codec_ctx, nullptr);
+void VideoEncoder::write_frames() {
+    try {
+        while (frame_queue->pop([&](const FrameSlot &slot) {
+            encode_frame(codec_ctx, stream, slot.frame);
+            if (audio_codec_ctx) {
+                encode_audio(slot.audio, slot.frame->pts);
+            }
+        })) {
+        }
+        flush_encoder(codec_ctx, stream);
+        if (audio_codec_ctx) {
+            flush_encoder(audio_codec_ctx, audio_stream);
+        }
+    } catch (...) {
+        writer_error = std::current_exception();
+        writer_failed.store(true, std::memory_order_release);
+        // Keep draining so the embedding side never blocks on a full ring; it picks the error
+        // up on its next frame or in finalize().
+        while (frame_queue->pop([](const FrameSlot &) {
+        })) {
+        }
+    }
+}
+
+void VideoEncoder::flush_encoder(AVCodecContext *ctx, const AVStream *st) const {
+    int ret = avcodec_send_frame(ctx, nullptr);
 
     while (ret >= 0) {
-        ret = avcodec_receive_packet(codec_ctx, av_packet);
+        ret = avcodec_receive_packet(ctx, av_packet);
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             break;
         }
@@ -293,10 +750,14 @@ void VideoEncoder::flush_encoder() const {
             throw std::runtime_error("Error flushing encoder");
         }
 
-        av_packet_rescale_ts(av_packet, codec_ctx->time_base, stream->time_base);
-        av_packet->stream_index = stream->index;
+        av_packet_rescale_ts(av_packet, ctx->time_base, st->time_base);
+        av_packet->stream_index = st->index;
+
+        ret = av_interleaved_write_frame(format_ctx, av_packet);
+        if (ret < 0) {
+            throw std::runtime_error("Error writing frame");
+        }
 
-        av_interleaved_write_frame(format_ctx, av_packet);
         av_packet_unref(av_packet);
     }
 }
@@ -304,7 +765,31 @@ void VideoEncoder::flush_encoder() const {
 void VideoEncoder::finalize() {
     if (finalized) return;
     finalized = true;
-    flush_frame_buffer();
-    flush_encoder();
+
+    std::exception_ptr error;
+    try {
+        flush_frame_buffer();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    frame_queue->close();
+    writer.join();
+    if (!error && writer_failed.load(std::memory_order_acquire)) {
+        error = writer_error;
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
     av_write_trailer(format_ctx);
+    if (sink_) {
+        sink_->finish();
+    }
+}
+
+uint64_t VideoEncoder::bytes_written() const {
+    if (sink_) {
+        return sink_->bytes_sent();
+    }
+    const int64_t size = format_ctx && format_ctx->pb ? avio_size(format_ctx->pb) : 0;
+    return size > 0 ? static_cast<uint64_t>(size) : 0;
 }
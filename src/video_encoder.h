@@ -18,8 +18,15 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 extern "C" {
@@ -27,19 +34,70 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
 }
 
 #include "configuration.h"
+#include "dct_common.h"
 #include "encoder.h"
+#include "spsc_queue.h"
+#include "stream_output.h"
 
-FrameLayout compute_frame_layout();
+FrameLayout compute_frame_layout(int bits_per_block = DEFAULT_BITS_PER_BLOCK, int width = DEFAULT_FRAME_WIDTH,
+                                 int height = DEFAULT_FRAME_HEIGHT);
 
-std::size_t max_packet_bytes_per_frame();
+// Direct mode for lossless codecs: each pixel holds `bits_per_pixel` bits (1, 2, 4 or 8) as one
+// of 2^bits evenly spaced levels, so fewer bits leave more margin between levels.
+FrameLayout compute_direct_frame_layout(int bits_per_pixel, int width = DEFAULT_FRAME_WIDTH,
+                                        int height = DEFAULT_FRAME_HEIGHT);
 
+// Chroma mode: `luma` plus U and V planes of the given size, each embedded the same way as the
+// luma and holding the next stretch of the frame's bytes.
+FrameLayout with_chroma_planes(const FrameLayout &luma, int chroma_width, int chroma_height);
+
+// Layout of plane 0 (luma), 1 (U) or 2 (V) on its own.
+FrameLayout plane_layout(const FrameLayout &layout, int plane);
+
+// U and V plane size when `format` is planar 8-bit YUV, which chroma mode writes and reads
+// directly; nullopt otherwise.
+std::optional<std::pair<int, int> > chroma_plane_size(AVPixelFormat format, int width, int height);
+
+std::size_t max_packet_bytes_per_frame(int bits_per_block = DEFAULT_BITS_PER_BLOCK);
+
+// Optional audio track carrying packets alongside the video. Every video frame gets one audio
+// frame of 16-bit samples holding whole packets; both codecs are lossless.
+enum class AudioTrack : uint8_t {
+    None,
+    Flac,
+    Pcm,
+};
+
+// Codec profile, embedding overrides, codec threading and the depth of the embed/compress
+// pipeline. Zero codec threads lets FFmpeg use one per core.
+struct VideoEncoderOptions {
+    std::string profile = DEFAULT_CODEC_PROFILE; // see codec_profiles()
+    int bits_per_block = 0; // 1 to MAX_BITS_PER_BLOCK DCT coefficients per block; 0 takes the profile's
+    int direct_bits_per_pixel = 0; // nonzero switches to direct pixel embedding (lossless profiles only)
+    int frame_width = DEFAULT_FRAME_WIDTH; // recorded in the codec parameters, so decoding needs no option
+    int frame_height = DEFAULT_FRAME_HEIGHT;
+    bool chroma = false; // embed into the U and V planes too (planar YUV profiles only)
+    AudioTrack audio = AudioTrack::None;
+    int codec_threads = 0;
+    int slices = FFV1_SLICES; // FFV1 only: must split as v x h slices with v <= h < 2v
+    bool slice_crc = true;
+    std::size_t queue_frames = VIDEO_ENCODE_QUEUE_FRAMES;
+    std::size_t write_behind = STREAM_WRITE_BEHIND_BYTES; // buffered ahead of a streamed output
+};
+
+// Packets are embedded into frames on the calling thread and compressed on a writer thread.
+// The two share a ring of `queue_frames` frames, so embedding the next frames overlaps the
+// codec working on the current one.
 class VideoEncoder {
 public:
-    explicit VideoEncoder(const std::string &output_path);
+    // `output_path` may also be "-" for stdout or a URL (see StreamOutput::is_stream_url); those are
+    // written as a streamable Matroska file through `options.write_behind` bytes of buffer.
+    explicit VideoEncoder(const std::string &output_path, const VideoEncoderOptions &options = {});
 
     ~VideoEncoder();
 
@@ -59,29 +117,75 @@ public:
 
     [[nodiscard]] int64_t frames_written() const { return frame_index; }
 
-    [[nodiscard]] static int packets_per_frame();
+    // Size of the finished video: bytes sent for a streamed output, else the file size.
+    [[nodiscard]] uint64_t bytes_written() const;
+
+    [[nodiscard]] int packets_per_frame() const;
+
+    // Packets the audio track adds to each frame; 0 without one.
+    [[nodiscard]] int audio_packets_per_frame() const;
 
 private:
+    struct FrameSlot {
+        AVFrame *frame = nullptr;
+        std::vector<uint8_t> gray_buffer;
+        std::vector<std::byte> audio; // packets for this frame's audio frame
+
+        FrameSlot() = default;
+
+        ~FrameSlot();
+
+        FrameSlot(const FrameSlot &) = delete;
+
+        FrameSlot &operator=(const FrameSlot &) = delete;
+    };
+
+    // Declared first so it outlives the format context writing to it.
+    std::unique_ptr<StreamOutput> sink_;
     AVFormatContext *format_ctx = nullptr;
     AVCodecContext *codec_ctx = nullptr;
     AVStream *stream = nullptr;
-    AVFrame *frame = nullptr;
     AVPacket *av_packet = nullptr;
     SwsContext *sws_ctx = nullptr;
+    AVCodecContext *audio_codec_ctx = nullptr;
+    AVStream *audio_stream = nullptr;
+    AVFrame *audio_frame = nullptr; // writer thread only
 
-    std::vector<uint8_t> gray_buffer;
     std::vector<std::byte> frame_data_buffer;
+    std::vector<std::byte> audio_data_buffer;
+    std::size_t audio_bytes_per_frame = 0;
     FrameLayout layout_{};
+    PrecomputedBlocks blocks_{};
+    std::vector<uint8_t> byte_rows_; // row segments per source byte, for 1, 2 and 4 bits per block
     int64_t frame_index = 0;
     bool finalized = false;
 
-    void init_encoder(const std::string &output_path);
+    std::unique_ptr<SpscQueue<FrameSlot> > frame_queue;
+    std::jthread writer;
+    std::exception_ptr writer_error;
+    std::atomic<bool> writer_failed{false};
+
+    void init_encoder(const std::string &output_path, const VideoEncoderOptions &options);
+
+    void init_audio(AudioTrack audio);
+
+    void prepare_slot(FrameSlot &slot) const;
+
+    void embed_data_in_frame(const std::vector<std::byte> &data, FrameSlot &slot) const;
+
+    void embed_plane(const FrameLayout &plane, const uint8_t *src, std::size_t size, uint8_t *dst_base,
+                     int dst_stride) const;
+
+    void embed_dct_blocks(const FrameLayout &plane, const uint8_t *src, std::size_t size, uint8_t *dst_base,
+                          int dst_stride) const;
+
+    void encode_frame(AVCodecContext *ctx, const AVStream *st, AVFrame *frame);
 
-    void embed_data_in_frame(const std::vector<std::byte> &data);
+    void encode_audio(const std::vector<std::byte> &data, int64_t pts);
 
-    void encode_frame();
+    void write_frames();
 
-    void flush_encoder() const;
+    void flush_encoder(AVCodecContext *ctx, const AVStream *st) const;
 
     void flush_frame_buffer();
 };